@@ -1,7 +1,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
 #include <unistd.h>
+#include <chrono>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -11,8 +13,12 @@
 extern "C" {
 #include "renderer.h"
 #include "microui.h"
+#include "wire.h"
+#include "record.h"
 }
 
+#include "microui.hpp"
+
 #include "ANativeWindowCreator.h"
 #include "ATouchEvent.h"
 
@@ -21,6 +27,28 @@ static std::atomic<bool> g_running{true};
 static std::mutex g_input_mutex;
 static mu_Context *g_ctx = nullptr;
 
+static std::atomic<mu_CommandBuffer*> g_published{nullptr};
+static std::atomic<mu_CommandBuffer*> g_reading{nullptr};
+static int g_versions[MU_COMMANDBUFFERS];
+
+static wire_Stream g_wire;
+static std::atomic<bool> g_remote{false};
+
+struct FrameTimer {
+    const char *name;
+    double total;
+    int count;
+
+    void add(std::chrono::steady_clock::time_point start) {
+        total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (++count == 120) {
+            printf("%s: %.3f ms/frame\n", name, total / count);
+            total = 0;
+            count = 0;
+        }
+    }
+};
+
 static char logbuf[64000];
 static int logbuf_updated = 0;
 
@@ -31,48 +59,48 @@ static void write_log(const char *text) {
 }
 
 static void test_window(mu_Context *ctx) {
-    if (mu_begin_window(ctx, "Demo Window", mu_rect(40, 40, 300, 450))) {
+    if (mu::Window window{ ctx, "Demo Window", mu_rect(40, 40, 300, 450) }) {
         mu_Container *win = mu_get_current_container(ctx);
         win->rect.w = mu_max(win->rect.w, 240);
         win->rect.h = mu_max(win->rect.h, 300);
 
-        if (mu_header(ctx, "Window Info")) {
+        if (mu::header(ctx, "Window Info")) {
             char buf[64];
             mu_layout_row(ctx, 2, (int[]) { 54, -1 }, 0);
-            mu_label(ctx, "Position:");
+            mu_label_ex(ctx, "Position:", MU_OPT_TEXTREF);
             sprintf(buf, "%d, %d", win->rect.x, win->rect.y);
             mu_label(ctx, buf);
-            mu_label(ctx, "Size:");
+            mu_label_ex(ctx, "Size:", MU_OPT_TEXTREF);
             sprintf(buf, "%d, %d", win->rect.w, win->rect.h);
             mu_label(ctx, buf);
         }
 
-        if (mu_header_ex(ctx, "Test Buttons", MU_OPT_EXPANDED)) {
+        if (mu::header(ctx, "Test Buttons", MU_OPT_EXPANDED)) {
             mu_layout_row(ctx, 3, (int[]) { 86, -110, -1 }, 0);
-            mu_label(ctx, "Test buttons 1:");
-            if (mu_button(ctx, "Button 1")) write_log("Pressed button 1");
-            if (mu_button(ctx, "Button 2")) write_log("Pressed button 2");
-            mu_label(ctx, "Test buttons 2:");
-            if (mu_button(ctx, "Button 3")) write_log("Pressed button 3");
-            if (mu_button(ctx, "Popup")) mu_open_popup(ctx, "Test Popup");
-            if (mu_begin_popup(ctx, "Test Popup")) {
-                mu_button(ctx, "Hello");
-                mu_button(ctx, "World");
-                mu_end_popup(ctx);
+            mu_label_ex(ctx, "Test buttons 1:", MU_OPT_TEXTREF);
+            if (mu::button(ctx, "Button 1")) write_log("Pressed button 1");
+            if (mu::button(ctx, "Button 2")) write_log("Pressed button 2");
+            mu_label_ex(ctx, "Test buttons 2:", MU_OPT_TEXTREF);
+            if (mu::button(ctx, "Button 3")) write_log("Pressed button 3");
+            if (mu::button(ctx, "Popup")) mu::open_popup(ctx, "Test Popup");
+            if (mu::Popup popup{ ctx, "Test Popup" }) {
+                mu::button(ctx, "Hello");
+                mu::button(ctx, "World");
             }
         }
-        mu_end_window(ctx);
     }
 }
 
 static void log_window(mu_Context *ctx) {
-    if (mu_begin_window(ctx, "Log Window", mu_rect(350, 40, 300, 200))) {
+    if (mu::Window window{ ctx, "Log Window", mu_rect(350, 40, 300, 200) }) {
         mu_layout_row(ctx, 1, (int[]) { -1 }, -25);
-        mu_begin_panel(ctx, "Log Output");
-        mu_Container *panel = mu_get_current_container(ctx);
-        mu_layout_row(ctx, 1, (int[]) { -1 }, -1);
-        mu_text(ctx, logbuf);
-        mu_end_panel(ctx);
+        mu_Container *panel;
+        {
+            mu::Panel scope(ctx, "Log Output");
+            panel = mu_get_current_container(ctx);
+            mu_layout_row(ctx, 1, (int[]) { -1 }, -1);
+            mu_text_ex(ctx, logbuf, MU_OPT_TEXTREF);
+        }
         if (logbuf_updated) {
             panel->scroll.y = panel->content_size.y;
             logbuf_updated = 0;
@@ -84,22 +112,62 @@ static void log_window(mu_Context *ctx) {
             mu_set_focus(ctx, ctx->last_id);
             submitted = 1;
         }
-        if (mu_button(ctx, "Submit")) submitted = 1;
+        if (mu::button(ctx, "Submit")) submitted = 1;
         if (submitted) {
             write_log(buf);
             buf[0] = '\0';
         }
-        mu_end_window(ctx);
+    }
+}
+
+static const int HEATMAP_SIZE = 512;
+static const int HEATMAP_BAND = 64;
+static mu_Image g_heatmap;
+static unsigned char g_heatmap_pixels[HEATMAP_SIZE * HEATMAP_SIZE * 4];
+static bool g_heatmap_dirty[HEATMAP_SIZE / HEATMAP_BAND];
+static int g_heatmap_frame;
+
+static void fill_heatmap_band(int band) {
+    float t = g_heatmap_frame * 0.05f;
+    for (int y = band * HEATMAP_BAND; y < (band + 1) * HEATMAP_BAND; y++) {
+        for (int x = 0; x < HEATMAP_SIZE; x++) {
+            float v = 0.5f + 0.25f * (sinf(x * 0.031f + t) + cosf(y * 0.023f - t * 0.7f));
+            unsigned char *p = g_heatmap_pixels + (y * HEATMAP_SIZE + x) * 4;
+            p[0] = v * 255;
+            p[1] = (1 - fabsf(v * 2 - 1)) * 255;
+            p[2] = (1 - v) * 255;
+            p[3] = 255;
+        }
+    }
+    g_heatmap_dirty[band] = true;
+}
+
+static void stream_heatmap(void) {
+    int bands = HEATMAP_SIZE / HEATMAP_BAND;
+    fill_heatmap_band(g_heatmap_frame++ % bands);
+    for (int i = 0; i < bands; i++) {
+        if (!g_heatmap_dirty[i]) continue;
+        mu_Rect rect = mu_rect(0, i * HEATMAP_BAND, HEATMAP_SIZE, HEATMAP_BAND);
+        if (r_update_image(g_heatmap, rect, g_heatmap_pixels + i * HEATMAP_BAND * HEATMAP_SIZE * 4)) {
+            g_heatmap_dirty[i] = false;
+        }
+    }
+}
+
+static void heatmap_window(mu_Context *ctx) {
+    if (!g_heatmap) return;
+    if (mu::Window window{ ctx, "Heatmap", mu_rect(40, 500, 300, 320) }) {
+        mu_layout_row(ctx, 1, (int[]) { -1 }, -1);
+        mu_draw_image(ctx, g_heatmap, mu_layout_next(ctx), mu_rect(0, 0, HEATMAP_SIZE, HEATMAP_SIZE));
     }
 }
 
 static int uint8_slider(mu_Context *ctx, unsigned char *value, int low, int high) {
     static float tmp;
-    mu_push_id(ctx, &value, sizeof(value));
+    mu::IdScope id(ctx, &value, sizeof(value));
     tmp = *value;
     int res = mu_slider_ex(ctx, &tmp, low, high, 0, "%.0f", MU_OPT_ALIGNCENTER);
     *value = tmp;
-    mu_pop_id(ctx);
     return res;
 }
 
@@ -122,7 +190,7 @@ static void style_window(mu_Context *ctx) {
         { NULL }
     };
 
-    if (mu_begin_window(ctx, "Style Editor", mu_rect(350, 250, 300, 240))) {
+    if (mu::Window window{ ctx, "Style Editor", mu_rect(350, 250, 300, 240) }) {
         int sw = mu_get_current_container(ctx)->body.w * 0.14;
         mu_layout_row(ctx, 6, (int[]) { 80, sw, sw, sw, sw, -1 }, 0);
         for (int i = 0; colors[i].label; i++) {
@@ -133,7 +201,6 @@ static void style_window(mu_Context *ctx) {
             uint8_slider(ctx, &ctx->style->colors[i].a, 0, 255);
             mu_draw_rect(ctx, mu_layout_next(ctx), ctx->style->colors[i]);
         }
-        mu_end_window(ctx);
     }
 }
 
@@ -142,6 +209,7 @@ static void process_frame(mu_Context *ctx) {
     style_window(ctx);
     log_window(ctx);
     test_window(ctx);
+    heatmap_window(ctx);
     mu_end(ctx);
 }
 
@@ -156,6 +224,49 @@ static int text_height(mu_Font font) {
     return r_get_text_height();
 }
 
+static void render_thread(mu_Context *ctx) {
+    FrameTimer timer{"render", 0, 0};
+    int drawn = 0;
+
+    r_make_current(1);
+    while (g_running) {
+        mu_CommandBuffer *buf;
+        do {
+            buf = g_published.load();
+            g_reading.store(buf);
+        } while (g_published.load() != buf);
+
+        int version = buf ? g_versions[buf - ctx->buffers] : drawn;
+        if (buf && (version != drawn || r_pending_updates())) {
+            auto start = std::chrono::steady_clock::now();
+            r_clear(mu_color(0, 0, 0, 0));
+            r_draw_vertices(&buf->vertices);
+            r_present();
+            timer.add(start);
+            drawn = version;
+        }
+        g_reading.store(nullptr);
+        usleep(1000);
+    }
+    r_make_current(0);
+}
+
+static void input_event(int type, int x, int y) {
+    if (g_remote) {
+        wire_send_input(&g_wire, type, x, y);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_input_mutex);
+    if (!g_ctx) return;
+
+    switch (type) {
+        case WIRE_MOUSEMOVE: mu_input_mousemove(g_ctx, x, y); break;
+        case WIRE_MOUSEDOWN: mu_input_mousedown(g_ctx, x, y, MU_MOUSE_LEFT); break;
+        case WIRE_MOUSEUP:   mu_input_mouseup(g_ctx, x, y, MU_MOUSE_LEFT); break;
+    }
+}
+
 static void touch_thread(int screen_w, int screen_h, int theta, float ui_scale) {
     android::ATouchEvent touch;
     android::ATouchEvent::TouchEvent ev{};
@@ -170,20 +281,17 @@ static void touch_thread(int screen_w, int screen_h, int theta, float ui_scale)
         int x = ev.x / ui_scale;
         int y = ev.y / ui_scale;
 
-        std::lock_guard<std::mutex> lock(g_input_mutex);
-        if (!g_ctx) continue;
-
         switch (ev.type) {
             case android::ATouchEvent::EventType::Move:
-                mu_input_mousemove(g_ctx, x, y);
+                input_event(WIRE_MOUSEMOVE, x, y);
                 break;
             case android::ATouchEvent::EventType::TouchDown:
-                mu_input_mousemove(g_ctx, x, y);
-                mu_input_mousedown(g_ctx, x, y, MU_MOUSE_LEFT);
+                input_event(WIRE_MOUSEMOVE, x, y);
+                input_event(WIRE_MOUSEDOWN, x, y);
                 break;
             case android::ATouchEvent::EventType::TouchUp:
-                mu_input_mousemove(g_ctx, x, y);
-                mu_input_mouseup(g_ctx, x, y, MU_MOUSE_LEFT);
+                input_event(WIRE_MOUSEMOVE, x, y);
+                input_event(WIRE_MOUSEUP, x, y);
                 break;
             default:
                 break;
@@ -191,8 +299,182 @@ static void touch_thread(int screen_w, int screen_h, int theta, float ui_scale)
     }
 }
 
+static mu_Context* create_context(void) {
+    mu_Context *ctx = (mu_Context*)malloc(sizeof(mu_Context));
+    mu_init(ctx);
+    ctx->text_width = text_width;
+    ctx->text_height = text_height;
+    r_get_atlas(&ctx->atlas);
+    ctx->caps = MU_CAP_FRAME | MU_CAP_ORIGIN | MU_CAP_TEXTREF | MU_CAP_TEXTBLOCK | MU_CAP_TEXTSPANS | MU_CAP_POLYLINE | MU_CAP_GLYPHGRID | MU_CAP_SPRITES;
+    return ctx;
+}
+
+static void run_local(mu_Context *ctx, const char *record_path) {
+    rec_File rec;
+    bool recording = false;
+    if (record_path) {
+        std::lock_guard<std::mutex> lock(g_input_mutex);
+        recording = rec_create(&rec, record_path, ctx) == 0;
+        if (!recording) fprintf(stderr, "could not create %s\n", record_path);
+    }
+
+    if (!recording) {
+        g_heatmap = r_create_image(HEATMAP_SIZE, HEATMAP_SIZE);
+        for (int i = 0; i < HEATMAP_SIZE / HEATMAP_BAND; i++) fill_heatmap_band(i);
+    }
+
+    ctx->buffer_count = MU_COMMANDBUFFERS;
+    r_make_current(0);
+    std::thread draw_thread(render_thread, ctx);
+
+    FrameTimer timer{"ui", 0, 0};
+    int version = 0;
+
+    while (g_running) {
+        android::ANativeWindowCreator::ProcessMirrorDisplay();
+
+        while (g_reading.load() == mu_next_command_buffer(ctx)) std::this_thread::yield();
+
+        auto start = std::chrono::steady_clock::now();
+        if (g_heatmap) stream_heatmap();
+        {
+            std::lock_guard<std::mutex> lock(g_input_mutex);
+            process_frame(ctx);
+            if (recording) rec_write_frame(&rec, ctx);
+        }
+        if (mu_frame_changed(ctx)) version++;
+        mu_build_vertices(ctx);
+        mu_CommandBuffer *buf = mu_get_command_buffer(ctx);
+        g_versions[buf - ctx->buffers] = version;
+        g_published.store(buf);
+        timer.add(start);
+
+        usleep(16000);
+    }
+
+    g_running = false;
+    draw_thread.join();
+    r_make_current(1);
+
+    if (recording) {
+        std::lock_guard<std::mutex> lock(g_input_mutex);
+        ctx->input_hook = nullptr;
+        rec_close(&rec);
+    }
+}
+
+static void run_display(mu_Context *ctx, const char *path) {
+    if (wire_connect(&g_wire, path) != 0) {
+        fprintf(stderr, "could not connect to %s\n", path);
+        return;
+    }
+    g_remote = true;
+
+    FrameTimer timer{"render", 0, 0};
+
+    while (g_running) {
+        android::ANativeWindowCreator::ProcessMirrorDisplay();
+
+        mu_begin(ctx);
+        int changed = wire_receive_frame(&g_wire, ctx);
+        mu_end(ctx);
+        if (changed < 0) break;
+
+        if (changed || r_pending_updates()) {
+            auto start = std::chrono::steady_clock::now();
+            r_clear(mu_color(0, 0, 0, 0));
+            r_draw_vertices(mu_build_vertices(ctx));
+            r_present();
+            timer.add(start);
+        }
+    }
+
+    g_remote = false;
+    wire_close(&g_wire);
+}
+
+static int serve(const char *path) {
+    mu_Context *ctx = create_context();
+    printf("waiting for a display on %s\n", path);
+    if (wire_listen(&g_wire, path) != 0) {
+        fprintf(stderr, "could not listen on %s\n", path);
+        mu_deinit(ctx);
+        free(ctx);
+        return -1;
+    }
+
+    long bytes = 0;
+    int frames = 0;
+
+    while (g_running) {
+        if (wire_poll_input(&g_wire, ctx) < 0) break;
+        process_frame(ctx);
+        int n = wire_send_frame(&g_wire, ctx);
+        if (n < 0) break;
+        bytes += n;
+        if (++frames == 120) {
+            printf("wire: %.1f bytes/frame\n", bytes / (double)frames);
+            bytes = 0;
+            frames = 0;
+        }
+        usleep(16000);
+    }
+
+    wire_close(&g_wire);
+    mu_deinit(ctx);
+    free(ctx);
+    return 0;
+}
+
+static int replay(const char *path) {
+    rec_File rec;
+    if (rec_open(&rec, path) != 0) {
+        fprintf(stderr, "could not open %s\n", path);
+        return -1;
+    }
+    mu_Context *ctx = create_context();
+
+    int frames = 0, mismatched = 0, slowest = 0, res;
+    double total = 0, worst = 0;
+
+    while ((res = rec_read_frame(&rec, ctx)) > 0) {
+        auto start = std::chrono::steady_clock::now();
+        process_frame(ctx);
+        mu_build_vertices(ctx);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!rec_check_frame(&rec, ctx)) {
+            if (!mismatched) printf("frame %d: commands differ from the recording\n", frames);
+            mismatched++;
+        }
+        total += ms;
+        if (ms > worst) {
+            worst = ms;
+            slowest = frames;
+        }
+        frames++;
+    }
+    if (res < 0) fprintf(stderr, "%s: bad record after frame %d\n", path, frames);
+
+    printf("%d frames, %.3f ms/frame, slowest %.3f ms (frame %d), %d mismatched\n",
+        frames, frames ? total / frames : 0.0, worst, slowest, mismatched);
+
+    rec_close(&rec);
+    mu_deinit(ctx);
+    free(ctx);
+    return res < 0 || mismatched ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
-    (void)argc; (void)argv;
+    const char *serve_path = nullptr;
+    const char *display_path = nullptr;
+    const char *record_path = nullptr;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--serve")) serve_path = argv[++i];
+        else if (!strcmp(argv[i], "--display")) display_path = argv[++i];
+        else if (!strcmp(argv[i], "--record")) record_path = argv[++i];
+        else if (!strcmp(argv[i], "--replay")) return replay(argv[++i]);
+    }
+    if (serve_path) return serve(serve_path);
 
     auto displayInfo = android::ANativeWindowCreator::GetDisplayInfo();
     int screen_w = displayInfo.width;
@@ -207,10 +489,7 @@ int main(int argc, char **argv) {
     }
     r_set_size(screen_w, screen_h);
 
-    mu_Context *ctx = (mu_Context*)malloc(sizeof(mu_Context));
-    mu_init(ctx);
-    ctx->text_width = text_width;
-    ctx->text_height = text_height;
+    mu_Context *ctx = create_context();
 
     {
         std::lock_guard<std::mutex> lock(g_input_mutex);
@@ -222,28 +501,13 @@ int main(int argc, char **argv) {
 
     std::thread input_thread(touch_thread, screen_w, screen_h, theta, ui_scale);
 
-    while (g_running) {
-        android::ANativeWindowCreator::ProcessMirrorDisplay();
-        process_frame(ctx);
-
-        r_clear(mu_color(0, 0, 0, 0));
-        mu_Command *cmd = NULL;
-        while (mu_next_command(ctx, &cmd)) {
-            switch (cmd->type) {
-                case MU_COMMAND_TEXT: r_draw_text(cmd->text.str, cmd->text.pos, cmd->text.color); break;
-                case MU_COMMAND_RECT: r_draw_rect(cmd->rect.rect, cmd->rect.color); break;
-                case MU_COMMAND_ICON: r_draw_icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color); break;
-                case MU_COMMAND_CLIP: r_set_clip_rect(cmd->clip.rect); break;
-            }
-        }
-        r_present();
-
-        usleep(16000);
-    }
+    if (display_path) run_display(ctx, display_path);
+    else run_local(ctx, record_path);
 
     g_running = false;
     input_thread.join();
 
+    mu_deinit(ctx);
     free(ctx);
     r_destroy();
     android::ANativeWindowCreator::Destroy(native_window);
@@ -0,0 +1,202 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+
+static const char magic[4] = { 'M', 'U', 'R', '1' };
+
+static void reserve(rec_File *r, int need) {
+    if (need <= r->cap) return;
+    size_t n = r->cap ? (size_t)r->cap : 1024;
+    while (n < (size_t)need) n *= 2;
+    if (n > INT_MAX) n = INT_MAX;
+    r->buf = realloc(r->buf, n);
+    if (!r->buf) abort();
+    r->cap = n;
+}
+
+static void put_bytes(rec_File *r, const void *data, int len) {
+    reserve(r, r->size + len);
+    memcpy(r->buf + r->size, data, len);
+    r->size += len;
+}
+
+static int encode_varint(unsigned char *out, unsigned v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+static void put_varint(rec_File *r, unsigned v) {
+    unsigned char b[5];
+    put_bytes(r, b, encode_varint(b, v));
+}
+
+static void put_int(rec_File *r, int v) {
+    put_varint(r, ((unsigned)v << 1) ^ (unsigned)(v >> 31));
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, unsigned *v) {
+    int shift = 0;
+    *v = 0;
+    while (*p < end && shift < 32) {
+        int b = *(*p)++;
+        *v |= (unsigned)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+static int get_int(const unsigned char **p, const unsigned char *end, int *v) {
+    unsigned u;
+    if (get_varint(p, end, &u) < 0) return -1;
+    *v = (int)(u >> 1) ^ -(int)(u & 1);
+    return 0;
+}
+
+static void record_input(mu_Context *ctx, const mu_InputEvent *ev) {
+    rec_File *r = ctx->input_udata;
+    put_varint(r, ev->type);
+    switch (ev->type) {
+        case MU_INPUT_MOUSEMOVE:
+        case MU_INPUT_SCROLL:
+            put_int(r, ev->x);
+            put_int(r, ev->y);
+            break;
+        case MU_INPUT_MOUSEDOWN:
+        case MU_INPUT_MOUSEUP:
+            put_int(r, ev->x);
+            put_int(r, ev->y);
+            put_varint(r, ev->value);
+            break;
+        case MU_INPUT_KEYDOWN:
+        case MU_INPUT_KEYUP:
+            put_varint(r, ev->value);
+            break;
+        case MU_INPUT_TEXT: {
+            int len = strlen(ev->text);
+            put_varint(r, len);
+            put_bytes(r, ev->text, len);
+            break;
+        }
+    }
+    r->events++;
+}
+
+static void init(rec_File *r, FILE *fp) {
+    memset(r, 0, sizeof(*r));
+    r->fp = fp;
+    r->wire.fd = -1;
+}
+
+static int write_u32(FILE *fp, unsigned v) {
+    unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+    return fwrite(b, 1, 4, fp) == 4 ? 0 : -1;
+}
+
+int rec_create(rec_File *r, const char *path, mu_Context *ctx) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return -1;
+    init(r, fp);
+    if (fwrite(magic, 1, 4, fp) != 4) {
+        fclose(fp);
+        return -1;
+    }
+    ctx->input_hook = record_input;
+    ctx->input_udata = r;
+    return 0;
+}
+
+int rec_write_frame(rec_File *r, mu_Context *ctx) {
+    unsigned char hdr[5];
+    int n = encode_varint(hdr, r->events);
+    int size = wire_encode_frame(&r->wire, ctx) - 4;
+    if (write_u32(r->fp, n + r->size + size) < 0 ||
+        fwrite(hdr, 1, n, r->fp) != (size_t)n ||
+        (r->size && fwrite(r->buf, 1, r->size, r->fp) != (size_t)r->size) ||
+        fwrite(r->wire.msg + 4, 1, size, r->fp) != (size_t)size) return -1;
+    r->size = 0;
+    r->events = 0;
+    r->frame++;
+    return 0;
+}
+
+int rec_open(rec_File *r, const char *path) {
+    char m[4];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    init(r, fp);
+    if (fread(m, 1, 4, fp) != 4 || memcmp(m, magic, 4)) {
+        fclose(fp);
+        r->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int rec_read_frame(rec_File *r, mu_Context *ctx) {
+    unsigned char hdr[4];
+    unsigned count;
+    if (fread(hdr, 1, 4, r->fp) != 4) return 0;
+    unsigned len = hdr[0] | hdr[1] << 8 | hdr[2] << 16 | (unsigned)hdr[3] << 24;
+    if (len > WIRE_MAX_SIZE) return -1;
+    reserve(r, len + 1);
+    if (fread(r->buf, 1, len, r->fp) != len) return -1;
+
+    const unsigned char *p = r->buf, *end = r->buf + len;
+    if (get_varint(&p, end, &count) < 0) return -1;
+    for (; count > 0; count--) {
+        mu_InputEvent ev = { 0 };
+        unsigned type, value = 0, n;
+        char text[32];
+        if (get_varint(&p, end, &type) < 0) return -1;
+        ev.type = type;
+        switch (type) {
+            case MU_INPUT_MOUSEDOWN:
+            case MU_INPUT_MOUSEUP:
+                if (get_int(&p, end, &ev.x) < 0 || get_int(&p, end, &ev.y) < 0 ||
+                    get_varint(&p, end, &value) < 0) return -1;
+                break;
+            case MU_INPUT_MOUSEMOVE:
+            case MU_INPUT_SCROLL:
+                if (get_int(&p, end, &ev.x) < 0 || get_int(&p, end, &ev.y) < 0) return -1;
+                break;
+            case MU_INPUT_KEYDOWN:
+            case MU_INPUT_KEYUP:
+                if (get_varint(&p, end, &value) < 0) return -1;
+                break;
+            case MU_INPUT_TEXT:
+                if (get_varint(&p, end, &n) < 0 || n >= sizeof(text) || n > (unsigned)(end - p)) return -1;
+                memcpy(text, p, n);
+                text[n] = '\0';
+                p += n;
+                ev.text = text;
+                break;
+            default:
+                return -1;
+        }
+        ev.value = value;
+        mu_input_event(ctx, &ev);
+    }
+    if (wire_decode_frame(&r->wire, p, end - p) < 0) return -1;
+    r->frame++;
+    return 1;
+}
+
+int rec_check_frame(rec_File *r, mu_Context *ctx) {
+    wire_capture(&r->check, ctx);
+    return wire_same_frame(&r->check, wire_last_frame(&r->wire));
+}
+
+void rec_close(rec_File *r) {
+    if (r->fp) fclose(r->fp);
+    wire_close(&r->wire);
+    wire_free_frame(&r->check);
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,25 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include "microui.h"
+#include "wire.h"
+
+typedef struct {
+    FILE *fp;
+    unsigned char *buf;
+    int size, cap;
+    int events;
+    int frame;
+    wire_Stream wire;
+    wire_Frame check;
+} rec_File;
+
+int  rec_create(rec_File *r, const char *path, mu_Context *ctx);
+int  rec_write_frame(rec_File *r, mu_Context *ctx);
+int  rec_open(rec_File *r, const char *path);
+int  rec_read_frame(rec_File *r, mu_Context *ctx);
+int  rec_check_frame(rec_File *r, mu_Context *ctx);
+void rec_close(rec_File *r);
+
+#endif
@@ -2,20 +2,18 @@
 #include <GLES3/gl3.h>
 #include <android/native_window.h>
 #include <android/hardware_buffer.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
 #include "renderer.h"
 #include "atlas.inl"
 
-#define BUFFER_SIZE 16384
-
-static GLfloat   tex_buf[BUFFER_SIZE *  8];
-static GLfloat  vert_buf[BUFFER_SIZE *  8];
-static GLubyte color_buf[BUFFER_SIZE * 16];
-static GLuint  index_buf[BUFFER_SIZE *  6];
+#define MAX_TEXTURES 16
+#define MAX_UPDATES  64
+#define UPLOAD_SIZE  (1024 * 1024 * 4)
 
 static int width  = 800;
 static int height = 600;
-static int buf_idx;
 static float ui_scale = 2.0f;
 
 static EGLDisplay egl_display;
@@ -23,8 +21,16 @@ static EGLSurface egl_surface;
 static EGLContext egl_context;
 
 static GLuint shader_program;
-static GLuint vao, vbo_vert, vbo_tex, vbo_color, ebo;
-static GLuint texture_id;
+static GLuint list_vao, list_vbo, list_ebo;
+static GLuint projection_loc, rgba_loc, tex_scale_loc;
+
+static struct { GLuint id; int w, h; } textures[MAX_TEXTURES];
+static int texture_count;
+
+static struct { int image; mu_Rect rect; int offset; } updates[MAX_UPDATES];
+static unsigned char upload_buf[UPLOAD_SIZE];
+static int update_count, upload_idx;
+static pthread_mutex_t update_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static const char *vertex_shader_src =
     "#version 300 es\n"
@@ -34,9 +40,10 @@ static const char *vertex_shader_src =
     "out vec2 TexCoord;\n"
     "out vec4 Color;\n"
     "uniform mat4 projection;\n"
+    "uniform vec2 tex_scale;\n"
     "void main() {\n"
     "    gl_Position = projection * vec4(aPos, 0.0, 1.0);\n"
-    "    TexCoord = aTexCoord;\n"
+    "    TexCoord = aTexCoord * tex_scale;\n"
     "    Color = aColor;\n"
     "}\n";
 
@@ -47,9 +54,14 @@ static const char *fragment_shader_src =
     "in vec4 Color;\n"
     "out vec4 FragColor;\n"
     "uniform sampler2D tex;\n"
+    "uniform bool rgba;\n"
     "void main() {\n"
-    "    float alpha = texture(tex, TexCoord).r;\n"
-    "    FragColor = vec4(Color.rgb, Color.a * alpha);\n"
+    "    if (rgba) {\n"
+    "        FragColor = texture(tex, TexCoord) * Color;\n"
+    "    } else {\n"
+    "        float alpha = texture(tex, TexCoord).r;\n"
+    "        FragColor = vec4(Color.rgb, Color.a * alpha);\n"
+    "    }\n"
     "}\n";
 
 static GLuint compile_shader(GLenum type, const char *src) {
@@ -68,34 +80,27 @@ static void setup_shader(void) {
     glLinkProgram(shader_program);
     glDeleteShader(vs);
     glDeleteShader(fs);
+    projection_loc = glGetUniformLocation(shader_program, "projection");
+    rgba_loc = glGetUniformLocation(shader_program, "rgba");
+    tex_scale_loc = glGetUniformLocation(shader_program, "tex_scale");
 }
 
 static void setup_buffers(void) {
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo_vert);
-    glGenBuffers(1, &vbo_tex);
-    glGenBuffers(1, &vbo_color);
-    glGenBuffers(1, &ebo);
+    glGenVertexArrays(1, &list_vao);
+    glGenBuffers(1, &list_vbo);
+    glGenBuffers(1, &list_ebo);
 
-    glBindVertexArray(vao);
+    glBindVertexArray(list_vao);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_vert);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vert_buf), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, list_vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(mu_Vertex), (void*)offsetof(mu_Vertex, x));
     glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_tex);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tex_buf), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(mu_Vertex), (void*)offsetof(mu_Vertex, u));
     glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_color);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(color_buf), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(mu_Vertex), (void*)offsetof(mu_Vertex, color));
     glEnableVertexAttribArray(2);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buf), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, list_ebo);
 
     glBindVertexArray(0);
 }
@@ -161,32 +166,50 @@ int r_init(EGLNativeDisplayType native_display, EGLNativeWindowType native_windo
     setup_shader();
     setup_buffers();
 
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glGenTextures(1, &textures[0].id);
+    glBindTexture(GL_TEXTURE_2D, textures[0].id);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0,
         GL_RED, GL_UNSIGNED_BYTE, atlas_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    textures[0].w = ATLAS_WIDTH;
+    textures[0].h = ATLAS_HEIGHT;
+    texture_count = 1;
 
     return 0;
 }
 
+void r_make_current(int current) {
+    if (current) eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context);
+    else eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
 void r_destroy(void) {
-    glDeleteTextures(1, &texture_id);
-    glDeleteBuffers(1, &vbo_vert);
-    glDeleteBuffers(1, &vbo_tex);
-    glDeleteBuffers(1, &vbo_color);
-    glDeleteBuffers(1, &ebo);
-    glDeleteVertexArrays(1, &vao);
+    for (int i = 0; i < texture_count; i++) glDeleteTextures(1, &textures[i].id);
+    glDeleteBuffers(1, &list_vbo);
+    glDeleteBuffers(1, &list_ebo);
+    glDeleteVertexArrays(1, &list_vao);
     glDeleteProgram(shader_program);
     eglDestroySurface(egl_display, egl_surface);
     eglDestroyContext(egl_display, egl_context);
     eglTerminate(egl_display);
 }
 
-static void flush(void) {
-    if (buf_idx == 0) return;
+static void apply_updates(void) {
+    pthread_mutex_lock(&update_lock);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < update_count; i++) {
+        mu_Rect r = updates[i].rect;
+        glBindTexture(GL_TEXTURE_2D, textures[updates[i].image].id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h,
+            GL_RGBA, GL_UNSIGNED_BYTE, upload_buf + updates[i].offset);
+    }
+    update_count = 0;
+    upload_idx = 0;
+    pthread_mutex_unlock(&update_lock);
+}
 
+static void use_program(void) {
     glViewport(0, 0, width, height);
     glUseProgram(shader_program);
 
@@ -198,86 +221,44 @@ static void flush(void) {
         0, 0, -1, 0,
         -1, 1, 0, 1
     };
-    glUniformMatrix4fv(glGetUniformLocation(shader_program, "projection"), 1, GL_FALSE, projection);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_vert);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, buf_idx * 8 * sizeof(GLfloat), vert_buf);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_tex);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, buf_idx * 8 * sizeof(GLfloat), tex_buf);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_color);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, buf_idx * 16 * sizeof(GLubyte), color_buf);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, buf_idx * 6 * sizeof(GLuint), index_buf);
-
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, buf_idx * 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    buf_idx = 0;
-}
-
-static void push_quad(mu_Rect dst, mu_Rect src, mu_Color color) {
-    if (buf_idx == BUFFER_SIZE) flush();
-
-    int texvert_idx = buf_idx * 8;
-    int color_idx = buf_idx * 16;
-    int element_idx = buf_idx * 4;
-    int index_idx = buf_idx * 6;
-    buf_idx++;
-
-    float x = src.x / (float)ATLAS_WIDTH;
-    float y = src.y / (float)ATLAS_HEIGHT;
-    float w = src.w / (float)ATLAS_WIDTH;
-    float h = src.h / (float)ATLAS_HEIGHT;
-
-    tex_buf[texvert_idx + 0] = x;     tex_buf[texvert_idx + 1] = y;
-    tex_buf[texvert_idx + 2] = x + w; tex_buf[texvert_idx + 3] = y;
-    tex_buf[texvert_idx + 4] = x;     tex_buf[texvert_idx + 5] = y + h;
-    tex_buf[texvert_idx + 6] = x + w; tex_buf[texvert_idx + 7] = y + h;
-
-    vert_buf[texvert_idx + 0] = dst.x;         vert_buf[texvert_idx + 1] = dst.y;
-    vert_buf[texvert_idx + 2] = dst.x + dst.w; vert_buf[texvert_idx + 3] = dst.y;
-    vert_buf[texvert_idx + 4] = dst.x;         vert_buf[texvert_idx + 5] = dst.y + dst.h;
-    vert_buf[texvert_idx + 6] = dst.x + dst.w; vert_buf[texvert_idx + 7] = dst.y + dst.h;
-
-    memcpy(color_buf + color_idx +  0, &color, 4);
-    memcpy(color_buf + color_idx +  4, &color, 4);
-    memcpy(color_buf + color_idx +  8, &color, 4);
-    memcpy(color_buf + color_idx + 12, &color, 4);
-
-    index_buf[index_idx + 0] = element_idx + 0;
-    index_buf[index_idx + 1] = element_idx + 1;
-    index_buf[index_idx + 2] = element_idx + 2;
-    index_buf[index_idx + 3] = element_idx + 2;
-    index_buf[index_idx + 4] = element_idx + 3;
-    index_buf[index_idx + 5] = element_idx + 1;
+    glUniformMatrix4fv(projection_loc, 1, GL_FALSE, projection);
 }
 
-void r_draw_rect(mu_Rect rect, mu_Color color) {
-    push_quad(rect, atlas[ATLAS_WHITE], color);
+mu_Image r_create_image(int w, int h) {
+    if (texture_count == MAX_TEXTURES) return 0;
+    int image = texture_count++;
+    glGenTextures(1, &textures[image].id);
+    glBindTexture(GL_TEXTURE_2D, textures[image].id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    textures[image].w = w;
+    textures[image].h = h;
+    return image;
 }
 
-void r_draw_text(const char *text, mu_Vec2 pos, mu_Color color) {
-    mu_Rect dst = { pos.x, pos.y, 0, 0 };
-    for (const char *p = text; *p; p++) {
-        if ((*p & 0xc0) == 0x80) continue;
-        int chr = mu_min((unsigned char)*p, 127);
-        mu_Rect src = atlas[ATLAS_FONT + chr];
-        dst.w = src.w;
-        dst.h = src.h;
-        push_quad(dst, src, color);
-        dst.x += dst.w;
+int r_update_image(mu_Image image, mu_Rect rect, const void *pixels) {
+    int size = rect.w * rect.h * 4;
+    int queued = 0;
+    pthread_mutex_lock(&update_lock);
+    if (update_count < MAX_UPDATES && size <= UPLOAD_SIZE - upload_idx) {
+        updates[update_count].image = image;
+        updates[update_count].rect = rect;
+        updates[update_count].offset = upload_idx;
+        update_count++;
+        memcpy(upload_buf + upload_idx, pixels, size);
+        upload_idx += size;
+        queued = 1;
     }
+    pthread_mutex_unlock(&update_lock);
+    return queued;
 }
 
-void r_draw_icon(int id, mu_Rect rect, mu_Color color) {
-    mu_Rect src = atlas[id];
-    int x = rect.x + (rect.w - src.w) / 2;
-    int y = rect.y + (rect.h - src.h) / 2;
-    push_quad(mu_rect(x, y, src.w, src.h), src, color);
+int r_pending_updates(void) {
+    pthread_mutex_lock(&update_lock);
+    int n = update_count;
+    pthread_mutex_unlock(&update_lock);
+    return n;
 }
 
 int r_get_text_width(const char *text, int len) {
@@ -292,18 +273,45 @@ int r_get_text_width(const char *text, int len) {
 
 int r_get_text_height(void) { return 18; }
 
-void r_set_clip_rect(mu_Rect rect) {
-    flush();
+static void set_scissor(mu_Rect rect) {
     glScissor(rect.x * ui_scale, height - (rect.y + rect.h) * ui_scale, rect.w * ui_scale, rect.h * ui_scale);
 }
 
+void r_draw_vertices(const mu_VertexList *list) {
+    apply_updates();
+    use_program();
+
+    glBindVertexArray(list_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, list_vbo);
+    glBufferData(GL_ARRAY_BUFFER, list->vertex_count * sizeof(mu_Vertex), list->vertices, GL_STREAM_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, list->index_count * sizeof(unsigned), list->indices, GL_STREAM_DRAW);
+
+    for (int i = 0; i < list->range_count; i++) {
+        const mu_DrawRange *r = &list->ranges[i];
+        if (r->cmd || r->image < 0 || r->image >= texture_count) continue;
+        set_scissor(r->clip);
+        glBindTexture(GL_TEXTURE_2D, textures[r->image].id);
+        glUniform1i(rgba_loc, r->image != 0);
+        glUniform2f(tex_scale_loc, 1.0f / textures[r->image].w, 1.0f / textures[r->image].h);
+        glDrawElements(GL_TRIANGLES, r->count, GL_UNSIGNED_INT, (void*)(r->offset * sizeof(unsigned)));
+    }
+
+    glBindVertexArray(0);
+}
+
+void r_get_atlas(mu_Atlas *a) {
+    a->image = 0;
+    a->rects = atlas;
+    a->white = ATLAS_WHITE;
+    a->font = ATLAS_FONT;
+}
+
 void r_clear(mu_Color clr) {
-    flush();
+    glScissor(0, 0, width, height);
     glClearColor(clr.r / 255.f, clr.g / 255.f, clr.b / 255.f, clr.a / 255.f);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void r_present(void) {
-    flush();
     eglSwapBuffers(egl_display, egl_surface);
 }
@@ -6,16 +6,18 @@
 
 int  r_init(EGLNativeDisplayType native_display, EGLNativeWindowType native_window);
 void r_destroy(void);
+void r_make_current(int current);
 void r_get_size(int *w, int *h);
 void r_set_size(int w, int h);
 void r_set_scale(float scale);
 void r_get_logical_size(int *w, int *h);
-void r_draw_rect(mu_Rect rect, mu_Color color);
-void r_draw_text(const char *text, mu_Vec2 pos, mu_Color color);
-void r_draw_icon(int id, mu_Rect rect, mu_Color color);
+mu_Image r_create_image(int w, int h);
+int  r_update_image(mu_Image image, mu_Rect rect, const void *pixels);
+int  r_pending_updates(void);
 int  r_get_text_width(const char *text, int len);
 int  r_get_text_height(void);
-void r_set_clip_rect(mu_Rect rect);
+void r_draw_vertices(const mu_VertexList *list);
+void r_get_atlas(mu_Atlas *atlas);
 void r_clear(mu_Color color);
 void r_present(void);
 
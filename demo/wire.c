@@ -0,0 +1,571 @@
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "wire.h"
+
+#define SEARCH_WINDOW 32
+
+enum {
+    OP_COPY = 1,
+    OP_SKIP,
+    OP_NEW,
+    OP_PATCH
+};
+
+static void* grow(void *ptr, int *cap, int need, int item) {
+    if (need <= *cap) return ptr;
+    size_t n = *cap ? (size_t)*cap : 256;
+    while (n < (size_t)need) n *= 2;
+    if (n > INT_MAX) n = INT_MAX;
+    if (n > SIZE_MAX / item) abort();
+    ptr = realloc(ptr, n * item);
+    if (!ptr) abort();
+    *cap = n;
+    return ptr;
+}
+
+static void frame_reset(wire_Frame *f) {
+    f->size = 0;
+    f->count = 0;
+}
+
+static char* frame_push(wire_Frame *f, int size) {
+    f->data = grow(f->data, &f->cap, f->size + size, 1);
+    f->offsets = grow(f->offsets, &f->offset_cap, f->count + 1, sizeof(int));
+    f->offsets[f->count++] = f->size;
+    char *dst = f->data + f->size;
+    memset(dst, 0, size);
+    f->size += size;
+    return dst;
+}
+
+static mu_Command* frame_command(wire_Frame *f, int idx) {
+    return (mu_Command*)(f->data + f->offsets[idx]);
+}
+
+void wire_free_frame(wire_Frame *f) {
+    free(f->data);
+    free(f->offsets);
+    memset(f, 0, sizeof(*f));
+}
+
+static int align8(int size) {
+    return (size + 7) & -8;
+}
+
+#define MAX_TEXT ((int)(MU_MAX_COMMAND_SIZE - sizeof(mu_TextCommand)))
+
+static void add_text(wire_Frame *f, mu_Context *ctx, mu_Font font, mu_CmdVec2 pos, mu_Color color,
+                     const char *str, int len, int width) {
+    while (len > MAX_TEXT) {
+        int n = MAX_TEXT;
+        while (n > 1 && (str[n] & 0xc0) == 0x80) n--;
+        int w = ctx->text_width(font, str, n);
+        add_text(f, ctx, font, pos, color, str, n, w);
+        pos.x = mu_clamp(pos.x + w, -0x8000, 0x7fff);
+        str += n;
+        len -= n;
+        width = ctx->text_width(font, str, len);
+    }
+    mu_Command *dst = (mu_Command*)frame_push(f, align8(sizeof(mu_TextCommand) + len));
+    dst->base.type = MU_COMMAND_TEXT;
+    dst->base.size = align8(sizeof(mu_TextCommand) + len);
+    dst->text.pos = pos;
+    dst->text.color = color;
+    dst->text.width = width;
+    memcpy(dst->text.str, str, len);
+}
+
+static void add_command(wire_Frame *f, mu_Context *ctx, mu_Command *cmd) {
+    mu_Command *dst;
+    switch (cmd->type) {
+        case MU_COMMAND_TEXTREF: {
+            mu_TextRefCommand *tr = &cmd->textref;
+            add_text(f, ctx, tr->font, tr->pos, tr->color, tr->str, tr->len, tr->width);
+            return;
+        }
+        case MU_COMMAND_TEXTBLOCK:
+            if (cmd->textblock.str) {
+                mu_TextBlockCommand *tb = &cmd->textblock;
+                int base = tb->lines[0].start;
+                int len = tb->lines[tb->count - 1].end - base;
+                int head = sizeof(mu_TextBlockCommand) + (tb->count - 1) * sizeof(mu_TextLine);
+                if (head + len > MU_MAX_COMMAND_SIZE) {
+                    for (int i = 0; i < tb->count; i++) {
+                        mu_CmdVec2 pos = tb->pos;
+                        const char *str = tb->str + tb->lines[i].start;
+                        int n = tb->lines[i].end - tb->lines[i].start;
+                        pos.y = mu_clamp(pos.y + i * tb->line_height, -0x8000, 0x7fff);
+                        add_text(f, ctx, tb->font, pos, tb->color, str, n, ctx->text_width(tb->font, str, n));
+                    }
+                    return;
+                }
+                dst = (mu_Command*)frame_push(f, align8(head + len));
+                memcpy(dst, tb, head);
+                dst->base.size = align8(head + len);
+                dst->textblock.str = NULL;
+                for (int i = 0; i < tb->count; i++) {
+                    dst->textblock.lines[i].start -= base;
+                    dst->textblock.lines[i].end -= base;
+                }
+                memcpy(dst->textblock.lines + tb->count, tb->str + base, len);
+                dst->textblock.font = NULL;
+                return;
+            }
+            break;
+    }
+    dst = (mu_Command*)frame_push(f, cmd->base.size);
+    memcpy(dst, cmd, cmd->base.size);
+    switch (dst->type) {
+        case MU_COMMAND_TEXT:      dst->text.font = NULL; break;
+        case MU_COMMAND_TEXTBLOCK: dst->textblock.font = NULL; break;
+        case MU_COMMAND_TEXTSPANS: dst->textspans.font = NULL; break;
+        case MU_COMMAND_GLYPHGRID: dst->glyphgrid.font = NULL; break;
+    }
+}
+
+static int same_command(wire_Frame *a, int i, wire_Frame *b, int j) {
+    mu_Command *x = frame_command(a, i), *y = frame_command(b, j);
+    return x->base.size == y->base.size && !memcmp(x, y, x->base.size);
+}
+
+static void put_byte(wire_Stream *s, int b) {
+    s->msg = grow(s->msg, &s->msg_cap, s->msg_size + 1, 1);
+    s->msg[s->msg_size++] = b;
+}
+
+static void put_varint(wire_Stream *s, unsigned v) {
+    while (v >= 0x80) {
+        put_byte(s, (v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    put_byte(s, v);
+}
+
+static void put_op(wire_Stream *s, int op, int n) {
+    put_byte(s, op);
+    put_varint(s, n);
+}
+
+static void put_xor(wire_Stream *s, const char *src, const char *ref, int ref_size, int size) {
+    int i = 0;
+    while (i < size) {
+        int zeros = i, lits;
+        while (i < size && src[i] == (i < ref_size ? ref[i] : 0)) i++;
+        put_varint(s, i - zeros);
+        lits = i;
+        while (i < size && src[i] != (i < ref_size ? ref[i] : 0)) i++;
+        put_varint(s, i - lits);
+        for (int k = lits; k < i; k++) put_byte(s, src[k] ^ (k < ref_size ? ref[k] : 0));
+    }
+}
+
+static void remember(wire_Stream *s, wire_Frame *f, int idx) {
+    s->last[frame_command(f, idx)->type & 63] = idx;
+}
+
+static void put_new(wire_Stream *s, wire_Frame *cur, int idx) {
+    mu_Command *cmd = frame_command(cur, idx);
+    int ref = s->last[cmd->type & 63];
+    mu_Command *r = ref >= 0 ? frame_command(cur, ref) : NULL;
+    put_varint(s, cmd->type);
+    put_varint(s, cmd->base.size);
+    put_xor(s, (const char*)cmd, (const char*)r, r ? r->base.size : 0, cmd->base.size);
+    remember(s, cur, idx);
+}
+
+static int write_all(int fd, const void *data, int size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, int size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int find_command(wire_Frame *a, int i, wire_Frame *b, int from, int to) {
+    to = mu_min(to, b->count);
+    for (int k = from; k < to; k++) {
+        if (same_command(a, i, b, k)) return k;
+    }
+    return -1;
+}
+
+void wire_capture(wire_Frame *f, mu_Context *ctx) {
+    mu_Command *cmd = NULL;
+    frame_reset(f);
+    while (mu_next_command(ctx, &cmd)) add_command(f, ctx, cmd);
+}
+
+int wire_same_frame(const wire_Frame *a, const wire_Frame *b) {
+    return a->count == b->count && a->size == b->size && !memcmp(a->data, b->data, a->size);
+}
+
+wire_Frame* wire_last_frame(wire_Stream *s) {
+    return &s->frames[s->cur];
+}
+
+int wire_encode_frame(wire_Stream *s, mu_Context *ctx) {
+    wire_Frame *prev = &s->frames[s->cur];
+    wire_Frame *cur = &s->frames[s->cur ^ 1];
+    int i = 0, j = 0;
+
+    wire_capture(cur, ctx);
+
+    s->msg_size = 4;
+    s->msg = grow(s->msg, &s->msg_cap, 4, 1);
+    for (int k = 0; k < 64; k++) s->last[k] = -1;
+    while (i < cur->count) {
+        if (j < prev->count && same_command(cur, i, prev, j)) {
+            int n = 0;
+            while (i < cur->count && j < prev->count && same_command(cur, i, prev, j)) {
+                remember(s, cur, i);
+                i++; j++; n++;
+            }
+            put_op(s, OP_COPY, n);
+            continue;
+        }
+        int k = find_command(cur, i, prev, j + 1, j + SEARCH_WINDOW);
+        if (k >= 0) {
+            put_op(s, OP_SKIP, k - j);
+            j = k;
+            continue;
+        }
+        k = j < prev->count ? find_command(prev, j, cur, i + 1, i + SEARCH_WINDOW) : -1;
+        if (k >= 0) {
+            put_op(s, OP_NEW, k - i);
+            while (i < k) put_new(s, cur, i++);
+            continue;
+        }
+        if (j < prev->count && frame_command(cur, i)->type == frame_command(prev, j)->type &&
+            frame_command(cur, i)->base.size == frame_command(prev, j)->base.size) {
+            mu_Command *c = frame_command(cur, i), *p = frame_command(prev, j);
+            put_op(s, OP_PATCH, 1);
+            put_xor(s, (const char*)c, (const char*)p, p->base.size, c->base.size);
+            remember(s, cur, i);
+            i++; j++;
+            continue;
+        }
+        put_op(s, OP_NEW, 1);
+        put_new(s, cur, i++);
+        if (j < prev->count) {
+            put_op(s, OP_SKIP, 1);
+            j++;
+        }
+    }
+
+    unsigned len = s->msg_size - 4;
+    s->msg[0] = len; s->msg[1] = len >> 8; s->msg[2] = len >> 16; s->msg[3] = len >> 24;
+    s->cur ^= 1;
+    return s->msg_size;
+}
+
+int wire_send_frame(wire_Stream *s, mu_Context *ctx) {
+    int size = wire_encode_frame(s, ctx);
+    if (write_all(s->fd, s->msg, size) < 0) return -1;
+    return size;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, unsigned *v) {
+    int shift = 0;
+    *v = 0;
+    while (*p < end && shift < 32) {
+        int b = *(*p)++;
+        *v |= (unsigned)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+static int get_xor(const unsigned char **p, const unsigned char *end, char *dst, const char *ref, int ref_size, int size) {
+    int i = 0;
+    while (i < size) {
+        unsigned zeros, lits;
+        if (get_varint(p, end, &zeros) < 0 || zeros > (unsigned)(size - i)) return -1;
+        for (; zeros > 0; zeros--, i++) dst[i] = i < ref_size ? ref[i] : 0;
+        if (get_varint(p, end, &lits) < 0 || lits > (unsigned)(size - i) || lits > (unsigned)(end - *p)) return -1;
+        for (; lits > 0; lits--, i++) dst[i] = *(*p)++ ^ (i < ref_size ? ref[i] : 0);
+    }
+    return 0;
+}
+
+static int check_command(mu_Command *c) {
+    int size = c->base.size;
+    switch (c->type) {
+        case MU_COMMAND_CLIP:   return size >= (int)sizeof(mu_ClipCommand);
+        case MU_COMMAND_RECT:   return size >= (int)sizeof(mu_RectCommand);
+        case MU_COMMAND_ICON:   return size >= (int)sizeof(mu_IconCommand);
+        case MU_COMMAND_FRAME:  return size >= (int)sizeof(mu_FrameCommand);
+        case MU_COMMAND_ORIGIN: return size >= (int)sizeof(mu_OriginCommand);
+        case MU_COMMAND_IMAGE:  return size >= (int)sizeof(mu_ImageCommand);
+        case MU_COMMAND_INPUT:  return size >= (int)sizeof(mu_InptCommand);
+        case MU_COMMAND_TEXT: {
+            int n = size - (int)offsetof(mu_TextCommand, str);
+            return size >= (int)sizeof(mu_TextCommand) && memchr(c->text.str, 0, n) != NULL;
+        }
+        case MU_COMMAND_TEXTBLOCK: {
+            mu_TextBlockCommand *tb = &c->textblock;
+            int n = size - (int)offsetof(mu_TextBlockCommand, lines);
+            if (size < (int)sizeof(*tb) || tb->str || tb->count < 1 ||
+                tb->count > n / (int)sizeof(mu_TextLine)) return 0;
+            n -= tb->count * (int)sizeof(mu_TextLine);
+            for (int i = 0; i < tb->count; i++) {
+                if (tb->lines[i].start < 0 || tb->lines[i].start > tb->lines[i].end ||
+                    tb->lines[i].end > n) return 0;
+            }
+            return 1;
+        }
+        case MU_COMMAND_TEXTSPANS: {
+            mu_TextSpansCommand *ts = &c->textspans;
+            int n = size - (int)offsetof(mu_TextSpansCommand, spans);
+            if (size < (int)sizeof(*ts) || ts->count < 1 ||
+                ts->count > n / (int)sizeof(mu_TextSpan)) return 0;
+            n -= ts->count * (int)sizeof(mu_TextSpan);
+            if (ts->len < 0 || ts->len > n || ts->spans[0].offset < 0) return 0;
+            for (int i = 0; i < ts->count; i++) {
+                int end = i == ts->count - 1 ? ts->len : ts->spans[i + 1].offset;
+                if (ts->spans[i].offset > end) return 0;
+            }
+            return 1;
+        }
+        case MU_COMMAND_POLYLINE: {
+            mu_PolylineCommand *pc = &c->polyline;
+            mu_Rect r = mu_decode_rect(pc->rect);
+            int n = size - (int)offsetof(mu_PolylineCommand, points);
+            if (size < (int)sizeof(*pc) || pc->count < 1 || pc->count > n / (int)sizeof(mu_CmdVec2) ||
+                r.w < 0 || r.w > 0x8000 || r.h < 0 || r.h > 0x8000) return 0;
+            for (int i = 0; i < pc->count; i++) {
+                mu_Vec2 v = mu_decode_vec2(pc->points[i]);
+                if ((unsigned)v.x - (unsigned)r.x >= (unsigned)r.w ||
+                    (unsigned)v.y - (unsigned)r.y >= (unsigned)r.h) return 0;
+            }
+            return 1;
+        }
+        case MU_COMMAND_SPRITES: {
+            int n = size - (int)offsetof(mu_SpritesCommand, sprites);
+            return size >= (int)sizeof(mu_SpritesCommand) && c->sprites.count >= 1 &&
+                c->sprites.count <= n / (int)sizeof(mu_Sprite);
+        }
+        case MU_COMMAND_GLYPHGRID: {
+            mu_GlyphGridCommand *gg = &c->glyphgrid;
+            int n = (size - (int)offsetof(mu_GlyphGridCommand, cells)) / (int)sizeof(mu_GlyphCell);
+            if (size < (int)sizeof(*gg) || gg->cols <= 0 || gg->rows <= 0 ||
+                gg->cell_w <= 0 || gg->cell_h <= 0 || gg->cols > n / gg->rows) return 0;
+            for (int i = 0; i < gg->cols * gg->rows; i++) {
+                if (gg->cells[i].fg >= MU_PALETTE_SIZE || gg->cells[i].bg >= MU_PALETTE_SIZE) return 0;
+            }
+            return 1;
+        }
+        default:
+            return c->type >= MU_COMMAND_CUSTOM && size >= (int)sizeof(mu_CustomCommand);
+    }
+}
+
+static int check_atlas_id(mu_Context *ctx, int id) {
+    return id >= 0 && id < ctx->atlas.font + 128;
+}
+
+static int check_push(mu_Context *ctx, mu_Command *c) {
+    switch (c->type) {
+        case MU_COMMAND_ICON:
+            return check_atlas_id(ctx, c->icon.id);
+        case MU_COMMAND_SPRITES:
+            for (int i = 0; i < c->sprites.count; i++) {
+                if (!check_atlas_id(ctx, c->sprites.sprites[i].id)) return 0;
+            }
+            return 1;
+    }
+    if (c->type < MU_COMMAND_CUSTOM) return 1;
+    int i = c->type - MU_COMMAND_CUSTOM;
+    int head = (int)((char*)mu_command_payload(c) - (char*)c);
+    return i < ctx->command_types.idx && c->base.size >= head + ctx->command_types.items[i];
+}
+
+int wire_decode_frame(wire_Stream *s, const unsigned char *data, int len) {
+    wire_Frame *prev = &s->frames[s->cur];
+    wire_Frame *cur = &s->frames[s->cur ^ 1];
+    const unsigned char *p = data, *end = data + len;
+    unsigned op, n;
+    int j = 0, changed = 0;
+
+    frame_reset(cur);
+    for (int k = 0; k < 64; k++) s->last[k] = -1;
+    while (p < end) {
+        op = *p++;
+        if (get_varint(&p, end, &n) < 0) return -1;
+        switch (op) {
+            case OP_COPY:
+                if (n > (unsigned)(prev->count - j)) return -1;
+                for (; n > 0; n--, j++) {
+                    mu_Command *c = frame_command(prev, j);
+                    if (c->base.size > WIRE_MAX_SIZE - cur->size) return -1;
+                    memcpy(frame_push(cur, c->base.size), c, c->base.size);
+                    remember(s, cur, cur->count - 1);
+                }
+                break;
+            case OP_SKIP:
+                if (n > (unsigned)(prev->count - j)) return -1;
+                j += n;
+                changed = 1;
+                break;
+            case OP_NEW:
+                for (; n > 0; n--) {
+                    unsigned type, size;
+                    if (get_varint(&p, end, &type) < 0 || get_varint(&p, end, &size) < 0) return -1;
+                    if (size < sizeof(mu_BaseCommand) || size > MU_MAX_COMMAND_SIZE || (size & 7) ||
+                        size > (unsigned)(WIRE_MAX_SIZE - cur->size)) return -1;
+                    int ref = s->last[type & 63];
+                    mu_Command *r = ref >= 0 ? frame_command(cur, ref) : NULL;
+                    int ref_size = r ? r->base.size : 0;
+                    char *dst = frame_push(cur, size);
+                    r = ref >= 0 ? frame_command(cur, ref) : NULL;
+                    if (get_xor(&p, end, dst, (const char*)r, ref_size, size) < 0) return -1;
+                    mu_Command *c = (mu_Command*)dst;
+                    if ((unsigned)c->type != type || (unsigned)c->base.size != size || !check_command(c)) return -1;
+                    remember(s, cur, cur->count - 1);
+                }
+                changed = 1;
+                break;
+            case OP_PATCH: {
+                if (n != 1 || j >= prev->count) return -1;
+                mu_Command *r = frame_command(prev, j++);
+                if (r->base.size > WIRE_MAX_SIZE - cur->size) return -1;
+                char *dst = frame_push(cur, r->base.size);
+                if (get_xor(&p, end, dst, (const char*)r, r->base.size, r->base.size) < 0) return -1;
+                mu_Command *c = (mu_Command*)dst;
+                if (c->type != r->type || c->base.size != r->base.size || !check_command(c)) return -1;
+                remember(s, cur, cur->count - 1);
+                changed = 1;
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+    if (j != prev->count) changed = 1;
+    s->cur ^= 1;
+    return changed;
+}
+
+int wire_push_frame(wire_Stream *s, mu_Context *ctx) {
+    wire_Frame *f = &s->frames[s->cur];
+    for (int k = 0; k < f->count; k++) {
+        if (!check_push(ctx, frame_command(f, k))) return -1;
+    }
+    for (int k = 0; k < f->count; k++) {
+        mu_Command *c = frame_command(f, k);
+        memcpy(mu_push_command(ctx, c->type, c->base.size), c, c->base.size);
+    }
+    return 0;
+}
+
+int wire_receive_frame(wire_Stream *s, mu_Context *ctx) {
+    unsigned char hdr[4];
+    if (read_all(s->fd, hdr, 4) < 0) return -1;
+    unsigned len = hdr[0] | hdr[1] << 8 | hdr[2] << 16 | (unsigned)hdr[3] << 24;
+    if (len > WIRE_MAX_SIZE) return -1;
+    s->msg = grow(s->msg, &s->msg_cap, len, 1);
+    if (read_all(s->fd, s->msg, len) < 0) return -1;
+    int changed = wire_decode_frame(s, s->msg, len);
+    if (changed >= 0 && wire_push_frame(s, ctx) < 0) return -1;
+    return changed;
+}
+
+int wire_send_input(wire_Stream *s, int type, int x, int y) {
+    int32_t msg[3] = { type, x, y };
+    return write_all(s->fd, msg, sizeof(msg));
+}
+
+int wire_poll_input(wire_Stream *s, mu_Context *ctx) {
+    int count = 0;
+    for (;;) {
+        ssize_t n = recv(s->fd, s->input + s->input_len, sizeof(s->input) - s->input_len, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return count;
+        if (n <= 0) return -1;
+        s->input_len += n;
+        if (s->input_len < (int)sizeof(s->input)) continue;
+        s->input_len = 0;
+        int32_t msg[3];
+        memcpy(msg, s->input, sizeof(msg));
+        switch (msg[0]) {
+            case WIRE_MOUSEMOVE: mu_input_mousemove(ctx, msg[1], msg[2]); break;
+            case WIRE_MOUSEDOWN: mu_input_mousedown(ctx, msg[1], msg[2], MU_MOUSE_LEFT); break;
+            case WIRE_MOUSEUP:   mu_input_mouseup(ctx, msg[1], msg[2], MU_MOUSE_LEFT); break;
+        }
+        count++;
+    }
+}
+
+static int open_socket(const char *path, struct sockaddr_un *addr) {
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+static void stream_init(wire_Stream *s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+}
+
+int wire_listen(wire_Stream *s, const char *path) {
+    struct sockaddr_un addr;
+    int fd = open_socket(path, &addr);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    int conn = accept(fd, NULL, NULL);
+    close(fd);
+    unlink(path);
+    if (conn < 0) return -1;
+    stream_init(s, conn);
+    return 0;
+}
+
+int wire_connect(wire_Stream *s, const char *path) {
+    struct sockaddr_un addr;
+    int fd = open_socket(path, &addr);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    stream_init(s, fd);
+    return 0;
+}
+
+void wire_close(wire_Stream *s) {
+    if (s->fd >= 0) close(s->fd);
+    wire_free_frame(&s->frames[0]);
+    wire_free_frame(&s->frames[1]);
+    free(s->msg);
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+}
@@ -0,0 +1,47 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "microui.h"
+
+#define WIRE_MAX_SIZE (16 << 20)
+
+enum {
+    WIRE_MOUSEMOVE,
+    WIRE_MOUSEDOWN,
+    WIRE_MOUSEUP
+};
+
+typedef struct {
+    char *data;
+    int size, cap;
+    int *offsets;
+    int count, offset_cap;
+} wire_Frame;
+
+typedef struct {
+    int fd;
+    wire_Frame frames[2];
+    int cur;
+    int last[64];
+    unsigned char *msg;
+    int msg_size, msg_cap;
+    unsigned char input[12];
+    int input_len;
+} wire_Stream;
+
+int  wire_listen(wire_Stream *s, const char *path);
+int  wire_connect(wire_Stream *s, const char *path);
+void wire_close(wire_Stream *s);
+void wire_capture(wire_Frame *f, mu_Context *ctx);
+int  wire_same_frame(const wire_Frame *a, const wire_Frame *b);
+void wire_free_frame(wire_Frame *f);
+wire_Frame* wire_last_frame(wire_Stream *s);
+int  wire_encode_frame(wire_Stream *s, mu_Context *ctx);
+int  wire_decode_frame(wire_Stream *s, const unsigned char *data, int len);
+int  wire_push_frame(wire_Stream *s, mu_Context *ctx);
+int  wire_send_frame(wire_Stream *s, mu_Context *ctx);
+int  wire_receive_frame(wire_Stream *s, mu_Context *ctx);
+int  wire_send_input(wire_Stream *s, int type, int x, int y);
+int  wire_poll_input(wire_Stream *s, mu_Context *ctx);
+
+#endif
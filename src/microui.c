@@ -45,6 +45,14 @@
   } while (0)
 
 
+/* command storage of a chunk starts after its header, padded to 8 bytes */
+#define CHUNK_HEADER_SIZE ((int) ((sizeof(mu_CommandChunk) + 7) & -8))
+#define chunk_items(c)    ((char*) (c) + CHUNK_HEADER_SIZE)
+
+/* every chunk keeps room for the jump that links it to the next one */
+#define JUMP_SIZE         ((int) ((sizeof(mu_JumpCommand) + 7) & -8))
+
+
 static mu_Rect unclipped_rect = { 0, 0, 0x1000000, 0x1000000 };
 
 static mu_Style default_style = {
@@ -70,6 +78,18 @@ static mu_Style default_style = {
   }
 };
 
+/* the 16 colors of a VGA text console */
+static const mu_Color default_palette[MU_PALETTE_SIZE] = {
+  { 0,   0,   0,   255 }, { 170, 0,   0,   255 },
+  { 0,   170, 0,   255 }, { 170, 85,  0,   255 },
+  { 0,   0,   170, 255 }, { 170, 0,   170, 255 },
+  { 0,   170, 170, 255 }, { 170, 170, 170, 255 },
+  { 85,  85,  85,  255 }, { 255, 85,  85,  255 },
+  { 85,  255, 85,  255 }, { 255, 255, 85,  255 },
+  { 85,  85,  255, 255 }, { 255, 85,  255, 255 },
+  { 85,  255, 255, 255 }, { 255, 255, 255, 255 }
+};
+
 
 mu_Vec2 mu_vec2(int x, int y) {
   mu_Vec2 res;
@@ -92,6 +112,56 @@ mu_Color mu_color(int r, int g, int b, int a) {
 }
 
 
+#ifdef MU_COMPACT_COMMANDS
+
+/* edges are clamped rather than the position and size so that a rect which
+** reaches past the 16-bit range keeps its visible part */
+static mu_CmdRect encode_rect(mu_Rect r) {
+  mu_CmdRect res;
+  int x1 = mu_clamp(r.x, -0x8000, 0x7fff), x2 = mu_clamp(r.x + r.w, x1, 0x7fff);
+  int y1 = mu_clamp(r.y, -0x8000, 0x7fff), y2 = mu_clamp(r.y + r.h, y1, 0x7fff);
+  res.x = x1; res.y = y1; res.w = x2 - x1; res.h = y2 - y1;
+  return res;
+}
+
+
+static mu_CmdVec2 encode_vec2(mu_Vec2 v) {
+  mu_CmdVec2 res;
+  res.x = mu_clamp(v.x, -0x8000, 0x7fff);
+  res.y = mu_clamp(v.y, -0x8000, 0x7fff);
+  return res;
+}
+
+
+mu_Rect mu_decode_rect(mu_CmdRect r) {
+  return mu_rect(r.x, r.y, r.w, r.h);
+}
+
+
+mu_Vec2 mu_decode_vec2(mu_CmdVec2 v) {
+  return mu_vec2(v.x, v.y);
+}
+
+#else
+#define encode_rect(r) (r)
+#define encode_vec2(v) (v)
+#endif
+
+
+/* geometry is stored relative to the current origin, which only moves from
+** 0,0 if the renderer supports MU_CAP_ORIGIN */
+static mu_CmdRect local_rect(mu_Context *ctx, mu_Rect r) {
+  mu_Vec2 o = ctx->origin;
+  return encode_rect(mu_rect(r.x - o.x, r.y - o.y, r.w, r.h));
+}
+
+
+static mu_CmdVec2 local_vec2(mu_Context *ctx, mu_Vec2 v) {
+  mu_Vec2 o = ctx->origin;
+  return encode_vec2(mu_vec2(v.x - o.x, v.y - o.y));
+}
+
+
 static mu_Rect expand_rect(mu_Rect rect, int n) {
   return mu_rect(rect.x - n, rect.y - n, rect.w + n * 2, rect.h + n * 2);
 }
@@ -113,29 +183,111 @@ static int rect_overlaps_vec2(mu_Rect r, mu_Vec2 p) {
 }
 
 
+static int div_round(int n, int d) {
+  return n < 0 ? -((d / 2 - n) / d) : (n + d / 2) / d;
+}
+
+
+static mu_Vec2 segment_point(mu_Vec2 a, mu_Vec2 b, int i, int n) {
+  if (n == 0) { return a; }
+  return mu_vec2(a.x + div_round(i * (b.x - a.x), n),
+                 a.y + div_round(i * (b.y - a.y), n));
+}
+
+
+/* steps a DDA line from a to b along its major axis; each run of pixels that
+** shares a minor coordinate is returned as one rect. `*i` is the pixel to
+** start from and is advanced past the run */
+static int next_segment_run(mu_Vec2 a, mu_Vec2 b, int *i, mu_Rect *r) {
+  int n = mu_max(abs(b.x - a.x), abs(b.y - a.y));
+  int xmajor = abs(b.x - a.x) >= abs(b.y - a.y);
+  int run = *i;
+  for (; *i <= n; (*i)++) {
+    mu_Vec2 p = segment_point(a, b, *i, n), q, s;
+    if (*i < n) {
+      q = segment_point(a, b, *i + 1, n);
+      if (xmajor ? q.y == p.y : q.x == p.x) { continue; }
+    }
+    s = segment_point(a, b, run, n);
+    *r = mu_rect(mu_min(s.x, p.x), mu_min(s.y, p.y),
+      abs(p.x - s.x) + 1, abs(p.y - s.y) + 1);
+    (*i)++;
+    return 1;
+  }
+  return 0;
+}
+
+
 static void draw_frame(mu_Context *ctx, mu_Rect rect, int colorid, int draw_border) {
-  mu_draw_rect(ctx, rect, ctx->style->colors[colorid]);
+  mu_Color border = ctx->style->colors[MU_COLOR_BORDER];
   if (colorid == MU_COLOR_SCROLLBASE  ||
       colorid == MU_COLOR_SCROLLTHUMB ||
-      colorid == MU_COLOR_TITLEBG) { return; }
-  /* draw border */
-  if (ctx->style->colors[MU_COLOR_BORDER].a && draw_border) {
-    mu_draw_box(ctx, expand_rect(rect, 1), ctx->style->colors[MU_COLOR_BORDER]);
-  }
+      colorid == MU_COLOR_TITLEBG) { draw_border = 0; }
+  /* draw fill and border */
+  draw_border = (border.a && draw_border) ? 1 : 0;
+  mu_draw_frame(ctx, rect, ctx->style->colors[colorid], border, draw_border);
+}
+
+
+static char* command_end(mu_CommandList *list) {
+  mu_CommandChunk *tail = list->tail;
+  return tail ? chunk_items(tail) + tail->idx : NULL;
+}
+
+
+static void* default_alloc(void *udata, void *ptr, int size) {
+  unused(udata);
+  if (size == 0) { free(ptr); return NULL; }
+  return realloc(ptr, size);
 }
 
 
 void mu_init(mu_Context *ctx) {
   memset(ctx, 0, sizeof(*ctx));
   ctx->draw_frame = draw_frame;
+  ctx->alloc = default_alloc;
   ctx->_style = default_style;
   ctx->style = &ctx->_style;
+  ctx->buffer = ctx->buffers;
+  mu_pool_setup(&ctx->container_pool, ctx->container_items,
+    ctx->container_index, MU_CONTAINERPOOL_SIZE);
+  mu_pool_setup(&ctx->treenode_pool, ctx->treenode_items,
+    ctx->treenode_index, MU_TREENODEPOOL_SIZE);
+}
+
+
+void mu_deinit(mu_Context *ctx) {
+  int i;
+  for (i = 0; i < MU_COMMANDBUFFERS; i++) {
+    mu_CommandBuffer *buf = &ctx->buffers[i];
+    mu_CommandChunk *chunk = buf->commands.head, *next;
+    while (chunk) {
+      next = chunk->next;
+      ctx->alloc(ctx->alloc_udata, chunk, 0);
+      chunk = next;
+    }
+    if (buf->vertices.vertices) {
+      ctx->alloc(ctx->alloc_udata, buf->vertices.vertices, 0);
+    }
+    if (buf->vertices.ranges) {
+      ctx->alloc(ctx->alloc_udata, buf->vertices.ranges, 0);
+    }
+    memset(buf, 0, sizeof(*buf));
+  }
+  if (ctx->flat_list) { ctx->alloc(ctx->alloc_udata, ctx->flat_list, 0); }
+  ctx->flat_list = NULL;
+  ctx->flat_size = 0;
+  if (ctx->primitives.x) { ctx->alloc(ctx->alloc_udata, ctx->primitives.x, 0); }
+  memset(&ctx->primitives, 0, sizeof(ctx->primitives));
 }
 
 
 void mu_begin(mu_Context *ctx) {
   expect(ctx->text_width && ctx->text_height);
-  ctx->command_list.idx = 0;
+  /* build into the next command buffer, leaving the previous frames' ones
+  ** untouched for whoever is still consuming them */
+  ctx->buffer = mu_next_command_buffer(ctx);
+  ctx->buffer->commands.tail = NULL;
   ctx->root_list.idx = 0;
   ctx->scroll_target = NULL;
   ctx->hover_root = ctx->next_hover_root;
@@ -149,10 +301,17 @@ void mu_begin(mu_Context *ctx) {
       ctx->touch_moved = 1;
     }
   }
-  ctx->frame++;
+  /* the frame counter only needs to differ between frames: pools compare it
+  ** for equality, so let it wrap instead of overflowing */
+  ctx->frame = (ctx->frame == 0x7fffffff) ? 1 : ctx->frame + 1;
+  ctx->buffer->frame = ctx->frame;
 }
 
 
+static int cull_occluded(mu_Context *ctx, int n);
+static void update_damage(mu_Context *ctx);
+
+
 static int compare_zindex(const void *a, const void *b) {
   return (*(mu_Container**) a)->zindex - (*(mu_Container**) b)->zindex;
 }
@@ -162,6 +321,7 @@ void mu_end(mu_Context *ctx) {
   int i, n;
   /* check stacks */
   expect(ctx->container_stack.idx == 0);
+  expect(ctx->origin_stack.idx    == 0);
   expect(ctx->clip_stack.idx      == 0);
   expect(ctx->id_stack.idx        == 0);
   expect(ctx->layout_stack.idx    == 0);
@@ -201,23 +361,34 @@ void mu_end(mu_Context *ctx) {
   n = ctx->root_list.idx;
   qsort(ctx->root_list.items, n, sizeof(mu_Container*), compare_zindex);
 
+  /* drop what is hidden behind opaque containers higher up */
+  n = ctx->root_list.idx = cull_occluded(ctx, n);
+
   /* set root container jump commands */
   for (i = 0; i < n; i++) {
     mu_Container *cnt = ctx->root_list.items[i];
     /* if this is the first container then make the first command jump to it.
     ** otherwise set the previous container's tail to jump to this one */
     if (i == 0) {
-      mu_Command *cmd = (mu_Command*) ctx->command_list.items;
-      cmd->jump.dst = (char*) cnt->head + sizeof(mu_JumpCommand);
+      mu_Command *cmd = (mu_Command*) chunk_items(ctx->buffer->commands.head);
+      cmd->jump.dst = (char*) cnt->head + cnt->head->base.size;
     } else {
       mu_Container *prev = ctx->root_list.items[i - 1];
-      prev->tail->jump.dst = (char*) cnt->head + sizeof(mu_JumpCommand);
+      prev->tail->jump.dst = (char*) cnt->head + cnt->head->base.size;
     }
     /* make the last container's tail jump to the end of command list */
     if (i == n - 1) {
-      cnt->tail->jump.dst = ctx->command_list.items + ctx->command_list.idx;
+      cnt->tail->jump.dst = command_end(&ctx->buffer->commands);
     }
   }
+
+  /* compare what each root container drew with the last frame */
+  update_damage(ctx);
+}
+
+
+int mu_frame_changed(mu_Context *ctx) {
+  return ctx->damage_list.idx > 0;
 }
 
 
@@ -227,26 +398,83 @@ void mu_set_focus(mu_Context *ctx, mu_Id id) {
 }
 
 
-/* 32bit fnv-1a hash */
-#define HASH_INITIAL 2166136261
+/* 64bit multiplicative hash of the data, taking 8 bytes per step; it does not
+** depend on the parent ID, so microui.hpp can compute it at compile time.
+** Each step folds the high half of the product back down, as a multiply
+** alone never moves a bit towards the low end */
+#define HASH_K       0x9e3779b97f4a7c15ULL
+#define HASH_INITIAL ((mu_Id) HASH_K)
 
-static void hash(mu_Id *hash, const void *data, int size) {
+static uint64_t load32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+uint64_t mu_digest(const void *data, int size) {
   const unsigned char *p = data;
-  while (size--) {
-    *hash = (*hash ^ *p++) * 16777619;
+  uint64_t h = (uint64_t) size * HASH_K, w;
+  for (; size > 8; size -= 8, p += 8) {
+    memcpy(&w, p, 8);
+    h = (h ^ w) * HASH_K;
+    h ^= h >> 32;
   }
+  /* the last 1-8 bytes, read as two overlapping halves */
+  if (size >= 4) {
+    w = load32(p) | load32(p + size - 4) << 32;
+  } else if (size > 0) {
+    w = p[0] | p[size >> 1] << 8 | p[size - 1] << 16;
+  } else {
+    w = 0;
+  }
+  return (h ^ w) * HASH_K;
+}
+
+/* combines a digest with the parent ID using the murmur3 mixer; mu_Id keeps
+** the low 32 bits if MU_ID32 is defined */
+static mu_Id hash_digest(mu_Id parent, uint64_t h) {
+  h ^= parent;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (mu_Id) h;
+}
+
+static void hash(mu_Id *hash, const void *data, int size) {
+  *hash = hash_digest(*hash, mu_digest(data, size));
 }
 
 
 mu_Id mu_get_id(mu_Context *ctx, const void *data, int size) {
   int idx = ctx->id_stack.idx;
   mu_Id res = (idx > 0) ? ctx->id_stack.items[idx - 1] : HASH_INITIAL;
-  hash(&res, data, size);
+  if (data == ctx->hint_data) {
+    res = hash_digest(res, ctx->hint_digest);
+    ctx->hint_data = NULL;
+  } else {
+    hash(&res, data, size);
+  }
   ctx->last_id = res;
   return res;
 }
 
 
+void mu_hint_id(mu_Context *ctx, const void *data, uint64_t digest) {
+  ctx->hint_data = data;
+  ctx->hint_digest = digest;
+}
+
+
+/* the ID of a NUL-terminated label; a digest passed to mu_hint_id() for
+** this label is used instead of measuring and hashing it */
+static mu_Id label_id(mu_Context *ctx, const char *label) {
+  if (label == ctx->hint_data) { return mu_get_id(ctx, label, 0); }
+  return mu_get_id(ctx, label, strlen(label));
+}
+
+
 void mu_push_id(mu_Context *ctx, const void *data, int size) {
   push(ctx->id_stack, mu_get_id(ctx, data, size));
 }
@@ -300,6 +528,22 @@ static mu_Layout* get_layout(mu_Context *ctx) {
 }
 
 
+static void set_origin(mu_Context *ctx, mu_Vec2 pos, int force) {
+  mu_Command *cmd;
+  if (~ctx->caps & MU_CAP_ORIGIN) { return; }
+  if (!force && pos.x == ctx->origin.x && pos.y == ctx->origin.y) { return; }
+  cmd = mu_push_command(ctx, MU_COMMAND_ORIGIN, sizeof(mu_OriginCommand));
+  cmd->origin.pos = pos;
+  ctx->origin = pos;
+}
+
+
+static void push_container(mu_Context *ctx, mu_Container *cnt) {
+  push(ctx->container_stack, cnt);
+  push(ctx->origin_stack, ctx->origin);
+}
+
+
 static void pop_container(mu_Context *ctx) {
   mu_Container *cnt = mu_get_current_container(ctx);
   mu_Layout *layout = get_layout(ctx);
@@ -309,6 +553,14 @@ static void pop_container(mu_Context *ctx) {
   pop(ctx->container_stack);
   pop(ctx->layout_stack);
   mu_pop_id(ctx);
+  /* restore the origin of the enclosing container; outside of any container
+  ** nothing is drawn, so only the value needs restoring */
+  pop(ctx->origin_stack);
+  if (ctx->container_stack.idx > 0) {
+    set_origin(ctx, ctx->origin_stack.items[ctx->origin_stack.idx], 0);
+  } else {
+    ctx->origin = ctx->origin_stack.items[ctx->origin_stack.idx];
+  }
 }
 
 
@@ -321,16 +573,16 @@ mu_Container* mu_get_current_container(mu_Context *ctx) {
 static mu_Container* get_container(mu_Context *ctx, mu_Id id, int opt) {
   mu_Container *cnt;
   /* try to get existing container from pool */
-  int idx = mu_pool_get(ctx, ctx->container_pool, MU_CONTAINERPOOL_SIZE, id);
+  int idx = mu_pool_get(ctx, &ctx->container_pool, id);
   if (idx >= 0) {
     if (ctx->containers[idx].open || ~opt & MU_OPT_CLOSED) {
-      mu_pool_update(ctx, ctx->container_pool, idx);
+      mu_pool_update(ctx, &ctx->container_pool, idx);
     }
     return &ctx->containers[idx];
   }
   if (opt & MU_OPT_CLOSED) { return NULL; }
   /* container not found in pool: init new container */
-  idx = mu_pool_init(ctx, ctx->container_pool, MU_CONTAINERPOOL_SIZE, id);
+  idx = mu_pool_init(ctx, &ctx->container_pool, id);
   cnt = &ctx->containers[idx];
   memset(cnt, 0, sizeof(*cnt));
   cnt->open = 1;
@@ -340,7 +592,7 @@ static mu_Container* get_container(mu_Context *ctx, mu_Id id, int opt) {
 
 
 mu_Container* mu_get_container(mu_Context *ctx, const char *name) {
-  mu_Id id = mu_get_id(ctx, name, strlen(name));
+  mu_Id id = label_id(ctx, name);
   return get_container(ctx, id, 0);
 }
 
@@ -354,33 +606,109 @@ void mu_bring_to_front(mu_Context *ctx, mu_Container *cnt) {
 ** pool
 **============================================================================*/
 
-int mu_pool_init(mu_Context *ctx, mu_PoolItem *items, int len, mu_Id id) {
-  int i, n = -1, f = ctx->frame;
-  for (i = 0; i < len; i++) {
-    if (items[i].last_update < f) {
-      f = items[i].last_update;
-      n = i;
+/* items are looked up through an open-addressing (linear probing) index of
+** `len * 2` slots keyed by id, so a lookup stays O(1) however large the pool
+** is. Ids are already hashes, so the id itself picks the home slot. Items are
+** also kept on a recency list (`head` oldest, `tail` newest) so eviction
+** takes the head instead of searching for the oldest `last_update` */
+
+static int pool_slot(mu_Pool *pool, mu_Id id) {
+  int n = pool->len * 2;
+  int i = id % n;
+  while (pool->index[i] && pool->items[pool->index[i] - 1].id != id) {
+    i = (i + 1) % n;
+  }
+  return i;
+}
+
+
+static void pool_unindex(mu_Pool *pool, int idx) {
+  int n = pool->len * 2;
+  int i = pool_slot(pool, pool->items[idx].id), j, k;
+  if (pool->index[i] != idx + 1) { return; }
+  pool->index[i] = 0;
+  /* shift back any entries that probed past the emptied slot so that no
+  ** probe sequence is broken by the hole */
+  for (j = (i + 1) % n; pool->index[j]; j = (j + 1) % n) {
+    k = pool->items[pool->index[j] - 1].id % n;
+    if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+      pool->index[i] = pool->index[j];
+      pool->index[j] = 0;
+      i = j;
     }
   }
-  expect(n > -1);
-  items[n].id = id;
-  mu_pool_update(ctx, items, n);
-  return n;
 }
 
 
-int mu_pool_get(mu_Context *ctx, mu_PoolItem *items, int len, mu_Id id) {
+static void pool_unlink(mu_Pool *pool, int idx) {
+  mu_PoolItem *item = &pool->items[idx];
+  if (item->prev >= 0) { pool->items[item->prev].next = item->next; }
+                  else { pool->head = item->next; }
+  if (item->next >= 0) { pool->items[item->next].prev = item->prev; }
+                  else { pool->tail = item->prev; }
+}
+
+
+void mu_pool_setup(mu_Pool *pool, mu_PoolItem *items, int *index, int len) {
   int i;
-  unused(ctx);
+  pool->items = items;
+  pool->index = index;
+  pool->len = len;
+  memset(items, 0, len * sizeof(*items));
+  memset(index, 0, len * 2 * sizeof(*index));
   for (i = 0; i < len; i++) {
-    if (items[i].id == id) { return i; }
+    items[i].prev = i - 1;
+    items[i].next = (i + 1 < len) ? i + 1 : -1;
   }
-  return -1;
+  pool->head = 0;
+  pool->tail = len - 1;
+}
+
+
+int mu_pool_init(mu_Context *ctx, mu_Pool *pool, mu_Id id) {
+  int n = pool->head;
+  /* every item being updated this frame means the pool is full */
+  expect(!pool->items[n].id || pool->items[n].last_update != ctx->frame);
+  pool_unindex(pool, n);
+  pool->items[n].id = id;
+  pool->index[pool_slot(pool, id)] = n + 1;
+  mu_pool_update(ctx, pool, n);
+  return n;
 }
 
 
-void mu_pool_update(mu_Context *ctx, mu_PoolItem *items, int idx) {
-  items[idx].last_update = ctx->frame;
+int mu_pool_get(mu_Context *ctx, mu_Pool *pool, mu_Id id) {
+  unused(ctx);
+  return pool->index[pool_slot(pool, id)] - 1;
+}
+
+
+void mu_pool_update(mu_Context *ctx, mu_Pool *pool, int idx) {
+  mu_PoolItem *item = &pool->items[idx];
+  item->last_update = ctx->frame;
+  if (pool->tail == idx) { return; }
+  /* move to the tail of the recency list */
+  pool_unlink(pool, idx);
+  item->prev = pool->tail;
+  item->next = -1;
+  pool->items[pool->tail].next = idx;
+  pool->tail = idx;
+}
+
+
+void mu_pool_remove(mu_Context *ctx, mu_Pool *pool, int idx) {
+  mu_PoolItem *item = &pool->items[idx];
+  unused(ctx);
+  pool_unindex(pool, idx);
+  item->id = 0;
+  item->last_update = 0;
+  if (pool->head == idx) { return; }
+  /* move to the head of the recency list so it is reused first */
+  pool_unlink(pool, idx);
+  item->prev = -1;
+  item->next = pool->head;
+  pool->items[pool->head].prev = idx;
+  pool->head = idx;
 }
 
 
@@ -388,13 +716,31 @@ void mu_pool_update(mu_Context *ctx, mu_PoolItem *items, int idx) {
 ** input handlers
 **============================================================================*/
 
+/* passes each input call to the context's `input_hook`, if it has one, so it
+** can be recorded and later replayed through mu_input_event() */
+static void hook_input(mu_Context *ctx, int type, int x, int y, int value,
+  const char *text)
+{
+  mu_InputEvent ev;
+  if (!ctx->input_hook) { return; }
+  ev.type = type;
+  ev.x = x;
+  ev.y = y;
+  ev.value = value;
+  ev.text = text;
+  ctx->input_hook(ctx, &ev);
+}
+
+
 void mu_input_mousemove(mu_Context *ctx, int x, int y) {
+  hook_input(ctx, MU_INPUT_MOUSEMOVE, x, y, 0, NULL);
   ctx->mouse_pos = mu_vec2(x, y);
 }
 
 
 void mu_input_mousedown(mu_Context *ctx, int x, int y, int btn) {
-  mu_input_mousemove(ctx, x, y);
+  hook_input(ctx, MU_INPUT_MOUSEDOWN, x, y, btn, NULL);
+  ctx->mouse_pos = mu_vec2(x, y);
   ctx->mouse_down |= btn;
   ctx->mouse_pressed |= btn;
   ctx->touch_start_pos = ctx->mouse_pos;
@@ -403,25 +749,29 @@ void mu_input_mousedown(mu_Context *ctx, int x, int y, int btn) {
 
 
 void mu_input_mouseup(mu_Context *ctx, int x, int y, int btn) {
-  mu_input_mousemove(ctx, x, y);
+  hook_input(ctx, MU_INPUT_MOUSEUP, x, y, btn, NULL);
+  ctx->mouse_pos = mu_vec2(x, y);
   ctx->mouse_down &= ~btn;
   ctx->mouse_released |= btn;
 }
 
 
 void mu_input_scroll(mu_Context *ctx, int x, int y) {
+  hook_input(ctx, MU_INPUT_SCROLL, x, y, 0, NULL);
   ctx->scroll_delta.x += x;
   ctx->scroll_delta.y += y;
 }
 
 
 void mu_input_keydown(mu_Context *ctx, int key) {
+  hook_input(ctx, MU_INPUT_KEYDOWN, 0, 0, key, NULL);
   ctx->key_pressed |= key;
   ctx->key_down |= key;
 }
 
 
 void mu_input_keyup(mu_Context *ctx, int key) {
+  hook_input(ctx, MU_INPUT_KEYUP, 0, 0, key, NULL);
   ctx->key_down &= ~key;
 }
 
@@ -430,35 +780,96 @@ void mu_input_text(mu_Context *ctx, const char *text) {
   int len = strlen(ctx->input_text);
   int size = strlen(text) + 1;
   expect(len + size <= (int) sizeof(ctx->input_text));
+  hook_input(ctx, MU_INPUT_TEXT, 0, 0, 0, text);
   memcpy(ctx->input_text + len, text, size);
 }
 
 
+void mu_input_event(mu_Context *ctx, const mu_InputEvent *ev) {
+  switch (ev->type) {
+    case MU_INPUT_MOUSEMOVE: mu_input_mousemove(ctx, ev->x, ev->y); break;
+    case MU_INPUT_MOUSEDOWN: mu_input_mousedown(ctx, ev->x, ev->y, ev->value); break;
+    case MU_INPUT_MOUSEUP: mu_input_mouseup(ctx, ev->x, ev->y, ev->value); break;
+    case MU_INPUT_SCROLL: mu_input_scroll(ctx, ev->x, ev->y); break;
+    case MU_INPUT_KEYDOWN: mu_input_keydown(ctx, ev->value); break;
+    case MU_INPUT_KEYUP: mu_input_keyup(ctx, ev->value); break;
+    case MU_INPUT_TEXT: mu_input_text(ctx, ev->text); break;
+  }
+}
+
+
 /*============================================================================
 ** commandlist
 **============================================================================*/
 
+static mu_CommandChunk* next_chunk(mu_Context *ctx, int size) {
+  mu_CommandList *list = &ctx->buffer->commands;
+  mu_CommandChunk *prev = list->tail;
+  mu_CommandChunk *chunk = prev ? prev->next : list->head;
+  /* chunks are kept between frames; a new one is only allocated if there is
+  ** no next chunk or it is too small for this command */
+  if (!chunk || chunk->size < size + JUMP_SIZE) {
+    int sz = mu_max(MU_COMMANDCHUNK_SIZE, size + JUMP_SIZE);
+    mu_CommandChunk *c = ctx->alloc(ctx->alloc_udata, NULL, CHUNK_HEADER_SIZE + sz);
+    expect(c != NULL);
+    c->size = sz;
+    c->next = chunk;
+    if (prev) { prev->next = c; } else { list->head = c; }
+    chunk = c;
+  }
+  chunk->idx = 0;
+  /* link the previous chunk to this one; jumps into the end of the previous
+  ** chunk land on this link and are carried over transparently */
+  if (prev) {
+    mu_Command *cmd = (mu_Command*) (chunk_items(prev) + prev->idx);
+    cmd->base.type = MU_COMMAND_JUMP;
+    cmd->base.size = JUMP_SIZE;
+    cmd->jump.dst = chunk_items(chunk);
+    prev->idx += JUMP_SIZE;
+  }
+  list->tail = chunk;
+  return chunk;
+}
+
+
 mu_Command* mu_push_command(mu_Context *ctx, int type, int size) {
-  mu_Command *cmd = (mu_Command*) (ctx->command_list.items + ctx->command_list.idx);
-  expect(ctx->command_list.idx + size < MU_COMMANDLIST_SIZE);
-  
+  mu_CommandChunk *chunk = ctx->buffer->commands.tail;
+  mu_Command *cmd;
   // Need to pad to the next multiple of 8 to respect alignment requirements.
   // https://github.com/rxi/microui/pull/67/commits/654a0b0396a57b50206bd5868e8a18341819765f
   size = (size+7) & -8;
+  expect(size <= MU_MAX_COMMAND_SIZE);
+  if (!chunk || chunk->idx + size + JUMP_SIZE > chunk->size) {
+    chunk = next_chunk(ctx, size);
+  }
+  cmd = (mu_Command*) (chunk_items(chunk) + chunk->idx);
+  /* cleared so that padding bytes are the same each frame, which lets
+  ** commands be hashed and compared as raw bytes */
+  memset(cmd, 0, size);
   cmd->base.type = type;
   cmd->base.size = size;
-  ctx->command_list.idx += size;
+  chunk->idx += size;
   return cmd;
 }
 
 
 int mu_next_command(mu_Context *ctx, mu_Command **cmd) {
+  return mu_next_buffer_command(ctx->buffer, cmd);
+}
+
+
+/* walks a command buffer without touching the context, so a buffer returned
+** by mu_get_command_buffer() can be drawn on another thread while the next
+** frame is being built */
+int mu_next_buffer_command(mu_CommandBuffer *buf, mu_Command **cmd) {
+  char *end = command_end(&buf->commands);
+  if (!end) { return 0; }
   if (*cmd) {
     *cmd = (mu_Command*) (((char*) *cmd) + (*cmd)->base.size);
   } else {
-    *cmd = (mu_Command*) ctx->command_list.items;
+    *cmd = (mu_Command*) chunk_items(buf->commands.head);
   }
-  while ((char*) *cmd != ctx->command_list.items + ctx->command_list.idx) {
+  while ((char*) *cmd != end) {
     if ((*cmd)->type != MU_COMMAND_JUMP) { return 1; }
     *cmd = (*cmd)->jump.dst;
   }
@@ -466,6 +877,681 @@ int mu_next_command(mu_Context *ctx, mu_Command **cmd) {
 }
 
 
+/* the buffer the current (or, after mu_end, the last) frame was built into */
+mu_CommandBuffer* mu_get_command_buffer(mu_Context *ctx) {
+  return ctx->buffer;
+}
+
+
+/* the buffer the next mu_begin will rotate into and overwrite */
+mu_CommandBuffer* mu_next_command_buffer(mu_Context *ctx) {
+  int n = mu_clamp(ctx->buffer_count, 1, MU_COMMANDBUFFERS);
+  return &ctx->buffers[(ctx->buffer - ctx->buffers + 1) % n];
+}
+
+
+/* screen-space bounds of a drawing command, given the origin in effect;
+** returns 0 for other commands */
+static int command_rect(mu_Context *ctx, mu_Command *cmd, mu_Vec2 origin,
+  mu_Rect *rect)
+{
+  mu_Rect r;
+  switch (cmd->type) {
+    case MU_COMMAND_RECT: r = mu_decode_rect(cmd->rect.rect); break;
+    case MU_COMMAND_ICON: r = mu_decode_rect(cmd->icon.rect); break;
+    case MU_COMMAND_IMAGE: r = mu_decode_rect(cmd->image.rect); break;
+    case MU_COMMAND_SPRITES: r = mu_decode_rect(cmd->sprites.rect); break;
+    case MU_COMMAND_FRAME:
+      r = expand_rect(mu_decode_rect(cmd->frame.rect), cmd->frame.border);
+      break;
+    case MU_COMMAND_TEXT: {
+      mu_Vec2 pos = mu_decode_vec2(cmd->text.pos);
+      r = mu_rect(pos.x, pos.y, cmd->text.width,
+        ctx->text_height(cmd->text.font));
+      break;
+    }
+    case MU_COMMAND_TEXTREF: {
+      mu_Vec2 pos = mu_decode_vec2(cmd->textref.pos);
+      r = mu_rect(pos.x, pos.y, cmd->textref.width,
+        ctx->text_height(cmd->textref.font));
+      break;
+    }
+    case MU_COMMAND_TEXTBLOCK: {
+      mu_TextBlockCommand *tb = &cmd->textblock;
+      mu_Vec2 pos = mu_decode_vec2(tb->pos);
+      r = mu_rect(pos.x, pos.y, tb->width,
+        (tb->count - 1) * tb->line_height + ctx->text_height(tb->font));
+      break;
+    }
+    case MU_COMMAND_TEXTSPANS: {
+      mu_Vec2 pos = mu_decode_vec2(cmd->textspans.pos);
+      r = mu_rect(pos.x, pos.y, cmd->textspans.width,
+        ctx->text_height(cmd->textspans.font));
+      break;
+    }
+    case MU_COMMAND_POLYLINE: r = mu_decode_rect(cmd->polyline.rect); break;
+    case MU_COMMAND_GLYPHGRID: {
+      mu_GlyphGridCommand *gg = &cmd->glyphgrid;
+      mu_Vec2 pos = mu_decode_vec2(gg->pos);
+      r = mu_rect(pos.x, pos.y, gg->cols * gg->cell_w, gg->rows * gg->cell_h);
+      break;
+    }
+    default:
+      if (cmd->type < MU_COMMAND_CUSTOM) { return 0; }
+      r = mu_decode_rect(cmd->custom.rect);
+      break;
+  }
+  *rect = mu_rect(r.x + origin.x, r.y + origin.y, r.w, r.h);
+  return 1;
+}
+
+
+static mu_Rect clip_rect(mu_Command *cmd, mu_Vec2 origin) {
+  mu_Rect r = mu_decode_rect(cmd->clip.rect);
+  return mu_rect(r.x + origin.x, r.y + origin.y, r.w, r.h);
+}
+
+
+static mu_Color command_color(mu_Command *cmd) {
+  switch (cmd->type) {
+    case MU_COMMAND_RECT: return cmd->rect.color;
+    case MU_COMMAND_ICON: return cmd->icon.color;
+    case MU_COMMAND_TEXT: return cmd->text.color;
+    case MU_COMMAND_TEXTREF: return cmd->textref.color;
+    case MU_COMMAND_TEXTBLOCK: return cmd->textblock.color;
+    case MU_COMMAND_TEXTSPANS: return cmd->textspans.spans[0].color;
+    case MU_COMMAND_POLYLINE: return cmd->polyline.color;
+    case MU_COMMAND_IMAGE: return mu_color(255, 255, 255, 255);
+    case MU_COMMAND_SPRITES: return cmd->sprites.sprites[0].color;
+    case MU_COMMAND_GLYPHGRID:
+      return cmd->glyphgrid.palette[cmd->glyphgrid.cells[0].bg];
+    case MU_COMMAND_FRAME: return cmd->frame.color;
+  }
+  return mu_color(0, 0, 0, 0);
+}
+
+
+int mu_flatten_commands(mu_Context *ctx, mu_Command **cmds) {
+  mu_Command *cmd = NULL;
+  int n = 0, size = 0;
+  char *dst;
+  /* measure, then copy the commands in z-order into one buffer with the
+  ** jumps resolved away; the buffer is kept and only grows */
+  while (mu_next_command(ctx, &cmd)) { size += cmd->base.size; n++; }
+  if (size > ctx->flat_size) {
+    if (ctx->flat_list) { ctx->alloc(ctx->alloc_udata, ctx->flat_list, 0); }
+    ctx->flat_list = ctx->alloc(ctx->alloc_udata, NULL, size);
+    expect(ctx->flat_list != NULL);
+    ctx->flat_size = size;
+  }
+  dst = ctx->flat_list;
+  cmd = NULL;
+  while (mu_next_command(ctx, &cmd)) {
+    memcpy(dst, cmd, cmd->base.size);
+    dst += cmd->base.size;
+  }
+  *cmds = (mu_Command*) ctx->flat_list;
+  return n;
+}
+
+
+static void grow_primitives(mu_Context *ctx, int cap) {
+  mu_PrimitiveList *pl = &ctx->primitives;
+  char *p;
+  if (cap <= pl->cap) { return; }
+  /* all arrays share one block: int arrays, then rects, colors and types */
+  if (pl->x) { ctx->alloc(ctx->alloc_udata, pl->x, 0); }
+  p = ctx->alloc(ctx->alloc_udata, NULL, cap * (int) (
+    6 * sizeof(int) + sizeof(mu_Rect) + sizeof(mu_Color) + 1));
+  expect(p != NULL);
+  pl->x     = (int*) p; p += cap * sizeof(int);
+  pl->y     = (int*) p; p += cap * sizeof(int);
+  pl->w     = (int*) p; p += cap * sizeof(int);
+  pl->h     = (int*) p; p += cap * sizeof(int);
+  pl->clip  = (int*) p; p += cap * sizeof(int);
+  pl->cmd   = (int*) p; p += cap * sizeof(int);
+  pl->clips = (mu_Rect*) p; p += cap * sizeof(mu_Rect);
+  pl->color = (mu_Color*) p; p += cap * sizeof(mu_Color);
+  pl->type  = (unsigned char*) p;
+  pl->cap = cap;
+}
+
+
+mu_PrimitiveList* mu_build_primitives(mu_Context *ctx) {
+  mu_PrimitiveList *pl = &ctx->primitives;
+  mu_Command *cmd;
+  mu_Rect r;
+  mu_Vec2 origin = mu_vec2(0, 0);
+  int i, n = mu_flatten_commands(ctx, &cmd);
+  /* one slot per command, plus the initial unclipped rect in `clips`;
+  ** geometry is made absolute */
+  grow_primitives(ctx, n + 1);
+  pl->count = 0;
+  pl->clip_count = 1;
+  pl->clips[0] = unclipped_rect;
+  for (i = 0; i < n; i++) {
+    if (cmd->type == MU_COMMAND_ORIGIN) {
+      origin = cmd->origin.pos;
+    } else if (cmd->type == MU_COMMAND_CLIP) {
+      pl->clips[pl->clip_count++] = clip_rect(cmd, origin);
+    } else if (command_rect(ctx, cmd, origin, &r)) {
+      int k = pl->count++;
+      pl->type[k] = cmd->type;
+      pl->x[k] = r.x; pl->y[k] = r.y; pl->w[k] = r.w; pl->h[k] = r.h;
+      pl->color[k] = command_color(cmd);
+      pl->clip[k] = pl->clip_count - 1;
+      pl->cmd[k] = (char*) cmd - ctx->flat_list;
+    }
+    cmd = (mu_Command*) ((char*) cmd + cmd->base.size);
+  }
+  return pl;
+}
+
+
+mu_Command* mu_primitive_command(mu_Context *ctx, int idx) {
+  return (mu_Command*) (ctx->flat_list + ctx->primitives.cmd[idx]);
+}
+
+
+static void grow_vertices(mu_Context *ctx, int cap) {
+  mu_VertexList *vl = &ctx->buffer->vertices;
+  char *p;
+  if (cap <= vl->vertex_cap) { return; }
+  cap = (mu_max(cap, mu_max(vl->vertex_cap * 2, 1024)) + 3) & ~3;
+  /* vertices and indices share one block, with 6 indices for every 4
+  ** vertices; the contents are kept */
+  p = ctx->alloc(ctx->alloc_udata, NULL,
+    cap * (int) sizeof(mu_Vertex) + cap / 4 * 6 * (int) sizeof(unsigned));
+  expect(p != NULL);
+  if (vl->vertices) {
+    memcpy(p, vl->vertices, vl->vertex_count * sizeof(mu_Vertex));
+    memcpy(p + cap * sizeof(mu_Vertex), vl->indices,
+      vl->index_count * sizeof(unsigned));
+    ctx->alloc(ctx->alloc_udata, vl->vertices, 0);
+  }
+  vl->vertices = (mu_Vertex*) p;
+  vl->indices = (unsigned*) (p + cap * sizeof(mu_Vertex));
+  vl->vertex_cap = cap;
+}
+
+
+static void set_range(mu_Context *ctx, mu_Rect clip, mu_Image image,
+  mu_Command *cmd)
+{
+  mu_VertexList *vl = &ctx->buffer->vertices;
+  mu_DrawRange *r = vl->range_count ? &vl->ranges[vl->range_count - 1] : NULL;
+  /* an empty range is reused rather than left in the list */
+  if (!r || r->count > 0 || r->cmd) {
+    if (vl->range_count == vl->range_cap) {
+      int cap = mu_max(vl->range_cap * 2, 64);
+      mu_DrawRange *p = ctx->alloc(ctx->alloc_udata, NULL,
+        cap * (int) sizeof(mu_DrawRange));
+      expect(p != NULL);
+      if (vl->ranges) {
+        memcpy(p, vl->ranges, vl->range_count * sizeof(mu_DrawRange));
+        ctx->alloc(ctx->alloc_udata, vl->ranges, 0);
+      }
+      vl->ranges = p;
+      vl->range_cap = cap;
+    }
+    r = &vl->ranges[vl->range_count++];
+  }
+  r->offset = vl->index_count;
+  r->count = 0;
+  r->clip = clip;
+  r->image = image;
+  r->cmd = cmd;
+  r->origin = mu_vec2(0, 0);
+}
+
+
+static void push_quad(mu_Context *ctx, mu_Image image, mu_Rect dst,
+  mu_Rect src, mu_Color color)
+{
+  mu_VertexList *vl = &ctx->buffer->vertices;
+  mu_DrawRange *r = &vl->ranges[vl->range_count - 1];
+  mu_Vertex *v;
+  unsigned *idx, n;
+  if (r->image != image || r->cmd) {
+    set_range(ctx, r->clip, image, NULL);
+    r = &vl->ranges[vl->range_count - 1];
+  }
+  grow_vertices(ctx, vl->vertex_count + 4);
+  v = vl->vertices + vl->vertex_count;
+  idx = vl->indices + vl->index_count;
+  n = vl->vertex_count;
+  v[0].x = dst.x;         v[0].y = dst.y;
+  v[1].x = dst.x + dst.w; v[1].y = dst.y;
+  v[2].x = dst.x;         v[2].y = dst.y + dst.h;
+  v[3].x = dst.x + dst.w; v[3].y = dst.y + dst.h;
+  v[0].u = src.x;         v[0].v = src.y;
+  v[1].u = src.x + src.w; v[1].v = src.y;
+  v[2].u = src.x;         v[2].v = src.y + src.h;
+  v[3].u = src.x + src.w; v[3].v = src.y + src.h;
+  v[0].color = v[1].color = v[2].color = v[3].color = color;
+  idx[0] = n + 0; idx[1] = n + 1; idx[2] = n + 2;
+  idx[3] = n + 2; idx[4] = n + 3; idx[5] = n + 1;
+  vl->vertex_count += 4;
+  vl->index_count += 6;
+  r->count += 6;
+}
+
+
+static mu_Rect atlas_rect(mu_Context *ctx, int idx) {
+  return ctx->atlas.rects[idx];
+}
+
+
+static int push_text(mu_Context *ctx, const char *str, int len, mu_Vec2 pos,
+  mu_Color color)
+{
+  /* utf-8 continuation bytes are skipped and other characters past 127 are
+  ** drawn as 127 */
+  for (; len > 0 && *str; str++, len--) {
+    mu_Rect src;
+    if ((*str & 0xc0) == 0x80) { continue; }
+    src = atlas_rect(ctx, ctx->atlas.font + mu_min((unsigned char) *str, 127));
+    push_quad(ctx, ctx->atlas.image, mu_rect(pos.x, pos.y, src.w, src.h), src,
+      color);
+    pos.x += src.w;
+  }
+  return pos.x;
+}
+
+
+static void push_command_vertices(mu_Context *ctx, mu_Command *cmd,
+  mu_Vec2 o)
+{
+  mu_Image atlas = ctx->atlas.image;
+  mu_Rect white = atlas_rect(ctx, ctx->atlas.white), r, src;
+  mu_Vec2 pos;
+  int i, j;
+  switch (cmd->type) {
+    case MU_COMMAND_RECT:
+      r = mu_decode_rect(cmd->rect.rect);
+      r.x += o.x; r.y += o.y;
+      push_quad(ctx, atlas, r, white, cmd->rect.color);
+      break;
+    case MU_COMMAND_FRAME: {
+      mu_Color bc = cmd->frame.border_color;
+      int b = cmd->frame.border;
+      r = mu_decode_rect(cmd->frame.rect);
+      r.x += o.x; r.y += o.y;
+      push_quad(ctx, atlas, r, white, cmd->frame.color);
+      r = expand_rect(r, b);
+      push_quad(ctx, atlas, mu_rect(r.x + b, r.y, r.w - b * 2, b), white, bc);
+      push_quad(ctx, atlas, mu_rect(r.x + b, r.y + r.h - b, r.w - b * 2, b),
+        white, bc);
+      push_quad(ctx, atlas, mu_rect(r.x, r.y, b, r.h), white, bc);
+      push_quad(ctx, atlas, mu_rect(r.x + r.w - b, r.y, b, r.h), white, bc);
+      break;
+    }
+    case MU_COMMAND_TEXT:
+      pos = mu_decode_vec2(cmd->text.pos);
+      push_text(ctx, cmd->text.str, strlen(cmd->text.str),
+        mu_vec2(pos.x + o.x, pos.y + o.y), cmd->text.color);
+      break;
+    case MU_COMMAND_TEXTREF:
+      pos = mu_decode_vec2(cmd->textref.pos);
+      push_text(ctx, cmd->textref.str, cmd->textref.len,
+        mu_vec2(pos.x + o.x, pos.y + o.y), cmd->textref.color);
+      break;
+    case MU_COMMAND_TEXTBLOCK: {
+      mu_TextBlockCommand *tb = &cmd->textblock;
+      const char *str = mu_textblock_str(cmd);
+      pos = mu_decode_vec2(tb->pos);
+      for (i = 0; i < tb->count; i++) {
+        push_text(ctx, str + tb->lines[i].start,
+          tb->lines[i].end - tb->lines[i].start,
+          mu_vec2(pos.x + o.x, pos.y + o.y + i * tb->line_height), tb->color);
+      }
+      break;
+    }
+    case MU_COMMAND_TEXTSPANS: {
+      mu_TextSpansCommand *ts = &cmd->textspans;
+      const char *str = mu_textspans_str(cmd);
+      pos = mu_decode_vec2(ts->pos);
+      pos = mu_vec2(pos.x + o.x, pos.y + o.y);
+      for (i = 0; i < ts->count; i++) {
+        int end = (i == ts->count - 1) ? ts->len : ts->spans[i + 1].offset;
+        pos.x = push_text(ctx, str + ts->spans[i].offset,
+          end - ts->spans[i].offset, pos, ts->spans[i].color);
+      }
+      break;
+    }
+    case MU_COMMAND_ICON:
+      r = mu_decode_rect(cmd->icon.rect);
+      src = atlas_rect(ctx, cmd->icon.id);
+      push_quad(ctx, atlas, mu_rect(r.x + o.x + (r.w - src.w) / 2,
+        r.y + o.y + (r.h - src.h) / 2, src.w, src.h), src, cmd->icon.color);
+      break;
+    case MU_COMMAND_SPRITES:
+      for (i = 0; i < cmd->sprites.count; i++) {
+        mu_Sprite *sp = &cmd->sprites.sprites[i];
+        r = mu_decode_rect(sp->rect);
+        src = atlas_rect(ctx, sp->id);
+        push_quad(ctx, atlas, mu_rect(r.x + o.x + (r.w - src.w) / 2,
+          r.y + o.y + (r.h - src.h) / 2, src.w, src.h), src, sp->color);
+      }
+      break;
+    case MU_COMMAND_IMAGE:
+      r = mu_decode_rect(cmd->image.rect);
+      r.x += o.x; r.y += o.y;
+      push_quad(ctx, cmd->image.image, r, mu_decode_rect(cmd->image.uv),
+        mu_color(255, 255, 255, 255));
+      break;
+    case MU_COMMAND_POLYLINE: {
+      mu_PolylineCommand *pc = &cmd->polyline;
+      mu_Vec2 a, b = mu_decode_vec2(pc->points[0]);
+      for (i = 0; i < pc->count; i++) {
+        a = b;
+        b = mu_decode_vec2(pc->points[i]);
+        j = i > 0;
+        while (next_segment_run(a, b, &j, &r)) {
+          r.x += o.x; r.y += o.y;
+          push_quad(ctx, atlas, r, white, pc->color);
+        }
+      }
+      break;
+    }
+    case MU_COMMAND_GLYPHGRID: {
+      mu_GlyphGridCommand *gg = &cmd->glyphgrid;
+      mu_GlyphCell *row = gg->cells;
+      int k;
+      pos = mu_decode_vec2(gg->pos);
+      pos = mu_vec2(pos.x + o.x, pos.y + o.y);
+      /* each row is one quad per run of equal backgrounds, then its glyphs */
+      for (j = 0; j < gg->rows; j++, row += gg->cols, pos.y += gg->cell_h) {
+        for (i = 0; i < gg->cols; i = k) {
+          for (k = i + 1; k < gg->cols && row[k].bg == row[i].bg; k++);
+          if (gg->palette[row[i].bg].a) {
+            r = mu_rect(pos.x + i * gg->cell_w, pos.y, (k - i) * gg->cell_w,
+              gg->cell_h);
+            push_quad(ctx, atlas, r, white, gg->palette[row[i].bg]);
+          }
+        }
+        for (i = 0; i < gg->cols; i++) {
+          if (row[i].chr <= ' ') { continue; }
+          src = atlas_rect(ctx, ctx->atlas.font + mu_min(row[i].chr, 127));
+          push_quad(ctx, atlas, mu_rect(pos.x + i * gg->cell_w, pos.y, src.w,
+            src.h), src, gg->palette[row[i].fg]);
+        }
+      }
+      break;
+    }
+  }
+}
+
+
+mu_VertexList* mu_build_vertices(mu_Context *ctx) {
+  mu_VertexList *vl = &ctx->buffer->vertices;
+  mu_Command *cmd = NULL;
+  mu_Rect clip = unclipped_rect;
+  mu_Vec2 origin = mu_vec2(0, 0);
+  expect(ctx->atlas.rects != NULL);
+  /* quads go into the last range; a new one starts when the clip rect or
+  ** image changes, and custom commands get one of their own. Geometry is
+  ** made absolute */
+  vl->vertex_count = vl->index_count = vl->range_count = 0;
+  set_range(ctx, clip, ctx->atlas.image, NULL);
+  while (mu_next_command(ctx, &cmd)) {
+    if (cmd->type == MU_COMMAND_ORIGIN) {
+      origin = cmd->origin.pos;
+    } else if (cmd->type == MU_COMMAND_CLIP) {
+      clip = clip_rect(cmd, origin);
+      set_range(ctx, clip, vl->ranges[vl->range_count - 1].image, NULL);
+    } else if (cmd->type >= MU_COMMAND_CUSTOM) {
+      set_range(ctx, clip, ctx->atlas.image, cmd);
+      vl->ranges[vl->range_count - 1].origin = origin;
+    } else {
+      push_command_vertices(ctx, cmd, origin);
+    }
+  }
+  if (vl->ranges[vl->range_count - 1].count == 0 &&
+      !vl->ranges[vl->range_count - 1].cmd) { vl->range_count--; }
+  return vl;
+}
+
+
+static int rect_equals(mu_Rect a, mu_Rect b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+
+static int drop_command(mu_Command *cmd, int *bytes) {
+  /* turned into a jump to the command that follows it */
+  *bytes += cmd->base.size;
+  cmd->type = MU_COMMAND_JUMP;
+  cmd->jump.dst = (char*) cmd + cmd->base.size;
+  return 1;
+}
+
+
+static int merge_rects(mu_Command *dst, mu_Command *src) {
+  mu_Rect a = mu_decode_rect(dst->rect.rect);
+  mu_Rect b = mu_decode_rect(src->rect.rect);
+  if (memcmp(&dst->rect.color, &src->rect.color, sizeof(mu_Color))) {
+    return 0;
+  }
+  if (a.y == b.y && a.h == b.h && (a.x + a.w == b.x || b.x + b.w == a.x)) {
+    a.x = mu_min(a.x, b.x); a.w += b.w;
+  } else if (a.x == b.x && a.w == b.w && (a.y + a.h == b.y || b.y + b.h == a.y)) {
+    a.y = mu_min(a.y, b.y); a.h += b.h;
+  } else {
+    return 0;
+  }
+  dst->rect.rect = encode_rect(a);
+  return 1;
+}
+
+
+int mu_optimize_commands(mu_Context *ctx, int *bytes) {
+  mu_Command *cmd = NULL, *pending = NULL, *last = NULL;
+  mu_Rect r, clip = unclipped_rect, pending_rect = unclipped_rect;
+  mu_Vec2 origin = mu_vec2(0, 0);
+  int n = 0, b = 0;
+  while (mu_next_command(ctx, &cmd)) {
+    if (cmd->type == MU_COMMAND_ORIGIN) {
+      origin = cmd->origin.pos;
+      last = NULL;
+    } else if (cmd->type == MU_COMMAND_CLIP) {
+      /* a clip that is replaced before anything is drawn has no effect, nor
+      ** has one that sets the rect that is already in use */
+      if (pending) { n += drop_command(pending, &b); }
+      pending = NULL;
+      r = clip_rect(cmd, origin);
+      if (rect_equals(r, clip)) {
+        n += drop_command(cmd, &b);
+      } else {
+        pending = cmd;
+        pending_rect = r;
+      }
+    } else if (cmd->type != MU_COMMAND_INPUT) {
+      if (pending) {
+        clip = pending_rect;
+        pending = NULL;
+        last = NULL;
+      }
+      if (cmd->type == MU_COMMAND_RECT && last && merge_rects(last, cmd)) {
+        n += drop_command(cmd, &b);
+      } else {
+        last = (cmd->type == MU_COMMAND_RECT) ? cmd : NULL;
+      }
+    }
+  }
+  /* a trailing clip is kept so the renderer is left in the same state */
+  if (bytes) { *bytes = b; }
+  return n;
+}
+
+
+static int rect_contains(mu_Rect r, mu_Rect sub) {
+  return sub.x >= r.x && sub.y >= r.y &&
+    sub.x + sub.w <= r.x + r.w && sub.y + sub.h <= r.y + r.h;
+}
+
+
+/* a root container is opaque if its first command fills its whole rect with
+** an opaque color, as the window background does */
+static int container_occluder(mu_Container *cnt) {
+  mu_Command *cmd = (mu_Command*) ((char*) cnt->head + cnt->head->base.size);
+  mu_Vec2 origin = mu_vec2(0, 0);
+  mu_Color color;
+  mu_Rect r;
+  for (;;) {
+    if (cmd == cnt->tail) { return 0; }
+    if (cmd->type == MU_COMMAND_JUMP) {
+      cmd = cmd->jump.dst;
+    } else if (cmd->type == MU_COMMAND_ORIGIN) {
+      origin = cmd->origin.pos;
+      cmd = (mu_Command*) ((char*) cmd + cmd->base.size);
+    } else {
+      break;
+    }
+  }
+  switch (cmd->type) {
+    case MU_COMMAND_RECT:
+      r = mu_decode_rect(cmd->rect.rect);
+      color = cmd->rect.color;
+      break;
+    case MU_COMMAND_FRAME:
+      r = mu_decode_rect(cmd->frame.rect);
+      color = cmd->frame.color;
+      break;
+    default: return 0;
+  }
+  r.x += origin.x;
+  r.y += origin.y;
+  return color.a == 255 && rect_equals(r, cnt->rect);
+}
+
+
+/* returns 1 if a draw command is inside one of the rects, 0 if it is not and
+** -1 for other commands */
+static int command_hidden(mu_Context *ctx, mu_Command *cmd, mu_Vec2 origin,
+  mu_Rect *rects, int n)
+{
+  mu_Rect r;
+  int i;
+  /* text is only measured if its position is covered at all */
+  if (cmd->type == MU_COMMAND_TEXT || cmd->type == MU_COMMAND_TEXTREF) {
+    mu_Vec2 pos = mu_decode_vec2(cmd->type == MU_COMMAND_TEXT ?
+      cmd->text.pos : cmd->textref.pos);
+    pos.x += origin.x;
+    pos.y += origin.y;
+    for (i = 0; i < n && !rect_overlaps_vec2(rects[i], pos); i++);
+    if (i == n) { return 0; }
+  }
+  if (!command_rect(ctx, cmd, origin, &r)) { return -1; }
+  for (i = 0; i < n && !rect_contains(rects[i], r); i++);
+  return i < n;
+}
+
+
+static int cull_occluded(mu_Context *ctx, int n) {
+  mu_Rect occluders[MU_ROOTLIST_SIZE];
+  int i, k, m = 0, bytes = 0;
+  /* go from the top container down, culling the draw commands that lie
+  ** entirely inside an opaque container above; containers left with nothing
+  ** to draw are removed from the root list */
+  for (i = n - 1; i >= 0; i--) {
+    mu_Container *cnt = ctx->root_list.items[i];
+    mu_Command *cmd = (mu_Command*) ((char*) cnt->head + cnt->head->base.size);
+    mu_Vec2 origin = mu_vec2(0, 0);
+    int visible = 0, opaque = container_occluder(cnt);
+    while (m > 0 && cmd != cnt->tail) {
+      if (cmd->type == MU_COMMAND_JUMP) { cmd = cmd->jump.dst; continue; }
+      if (cmd->type == MU_COMMAND_ORIGIN) { origin = cmd->origin.pos; }
+      switch (command_hidden(ctx, cmd, origin, occluders, m)) {
+        case 0: visible = 1; break;
+        case 1: drop_command(cmd, &bytes); break;
+      }
+      cmd = (mu_Command*) ((char*) cmd + cmd->base.size);
+    }
+    if (m > 0 && !visible) { ctx->root_list.items[i] = NULL; }
+    if (opaque) { occluders[m++] = cnt->rect; }
+  }
+  for (i = k = 0; i < n; i++) {
+    if (ctx->root_list.items[i]) {
+      ctx->root_list.items[k++] = ctx->root_list.items[i];
+    }
+  }
+  return k;
+}
+
+
+static mu_Rect union_rects(mu_Rect a, mu_Rect b) {
+  int x1, y1;
+  if (a.w <= 0 || a.h <= 0) { return b; }
+  if (b.w <= 0 || b.h <= 0) { return a; }
+  x1 = mu_max(a.x + a.w, b.x + b.w);
+  y1 = mu_max(a.y + a.h, b.y + b.h);
+  a.x = mu_min(a.x, b.x);
+  a.y = mu_min(a.y, b.y);
+  return mu_rect(a.x, a.y, x1 - a.x, y1 - a.y);
+}
+
+
+static void add_damage(mu_Context *ctx, mu_Rect rect) {
+  if (rect.w > 0 && rect.h > 0) { push(ctx->damage_list, rect); }
+}
+
+
+static void update_damage(mu_Context *ctx) {
+  mu_DrawnRoot drawn[MU_ROOTLIST_SIZE];
+  int i, j, n = ctx->root_list.idx, last = ctx->drawn_roots.idx, order = -1;
+  char seen[MU_ROOTLIST_SIZE] = { 0 };
+  ctx->damage_list.idx = 0;
+  for (i = 0; i < n; i++) {
+    mu_Container *cnt = ctx->root_list.items[i];
+    mu_Command *cmd = (mu_Command*) ((char*) cnt->head + cnt->head->base.size);
+    mu_Id h = HASH_INITIAL;
+    mu_Rect r, rect = mu_rect(0, 0, 0, 0);
+    mu_Vec2 origin = mu_vec2(0, 0);
+    /* hash the container's commands; they are cleared and padded to 8
+    ** bytes so the padding hashes the same every frame */
+    while (cmd != cnt->tail) {
+      if (cmd->type == MU_COMMAND_JUMP) { cmd = cmd->jump.dst; continue; }
+      hash(&h, cmd, cmd->base.size);
+      /* referenced text can change without the command changing */
+      if (cmd->type == MU_COMMAND_TEXTREF) {
+        hash(&h, cmd->textref.str, cmd->textref.len);
+      }
+      if (cmd->type == MU_COMMAND_TEXTBLOCK && cmd->textblock.str) {
+        mu_TextBlockCommand *tb = &cmd->textblock;
+        hash(&h, tb->str + tb->lines[0].start,
+          tb->lines[tb->count - 1].end - tb->lines[0].start);
+      }
+      if (cmd->type == MU_COMMAND_ORIGIN) { origin = cmd->origin.pos; }
+      if (command_rect(ctx, cmd, origin, &r)) { rect = union_rects(rect, r); }
+      cmd = (mu_Command*) ((char*) cmd + cmd->base.size);
+    }
+    drawn[i].container = cnt;
+    drawn[i].hash = h;
+    drawn[i].rect = rect;
+    /* damaged if new, changed, or moved relative to a container that was
+    ** above it last frame */
+    for (j = 0; j < last && ctx->drawn_roots.items[j].container != cnt; j++);
+    if (j == last) {
+      add_damage(ctx, rect);
+    } else {
+      mu_DrawnRoot *prev = &ctx->drawn_roots.items[j];
+      seen[j] = 1;
+      if (prev->hash != h || !rect_equals(prev->rect, rect) || j < order) {
+        add_damage(ctx, union_rects(prev->rect, rect));
+      }
+      order = mu_max(order, j);
+    }
+  }
+  /* containers which are no longer drawn leave their old area damaged */
+  for (j = 0; j < last; j++) {
+    if (!seen[j]) { add_damage(ctx, ctx->drawn_roots.items[j].rect); }
+  }
+  memcpy(ctx->drawn_roots.items, drawn, n * sizeof(mu_DrawnRoot));
+  ctx->drawn_roots.idx = n;
+}
+
+
 static mu_Command* push_jump(mu_Context *ctx, mu_Command *dst) {
   mu_Command *cmd;
   cmd = mu_push_command(ctx, MU_COMMAND_JUMP, sizeof(mu_JumpCommand));
@@ -474,7 +1560,7 @@ static mu_Command* push_jump(mu_Context *ctx, mu_Command *dst) {
 }
 
 static mu_Command *push_input(mu_Context *ctx, uint8_t status) {
-  mu_Command *cmd = mu_push_command(ctx, MU_COMMAND_INPUT, sizeof(MU_COMMAND_INPUT));
+  mu_Command *cmd = mu_push_command(ctx, MU_COMMAND_INPUT, sizeof(mu_InptCommand));
   cmd->input.status = status;
   return cmd;
 }
@@ -482,7 +1568,7 @@ static mu_Command *push_input(mu_Context *ctx, uint8_t status) {
 void mu_set_clip(mu_Context *ctx, mu_Rect rect) {
   mu_Command *cmd;
   cmd = mu_push_command(ctx, MU_COMMAND_CLIP, sizeof(mu_ClipCommand));
-  cmd->clip.rect = rect;
+  cmd->clip.rect = local_rect(ctx, rect);
 }
 
 
@@ -491,7 +1577,7 @@ void mu_draw_rect(mu_Context *ctx, mu_Rect rect, mu_Color color) {
   rect = intersect_rects(rect, mu_get_clip_rect(ctx));
   if (rect.w > 0 && rect.h > 0) {
     cmd = mu_push_command(ctx, MU_COMMAND_RECT, sizeof(mu_RectCommand));
-    cmd->rect.rect = rect;
+    cmd->rect.rect = local_rect(ctx, rect);
     cmd->rect.color = color;
   }
 }
@@ -505,28 +1591,170 @@ void mu_draw_box(mu_Context *ctx, mu_Rect rect, mu_Color color) {
 }
 
 
-void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len,
-  mu_Vec2 pos, mu_Color color)
+void mu_draw_frame(mu_Context *ctx, mu_Rect rect, mu_Color color,
+  mu_Color border_color, int border)
+{
+  mu_Command *cmd;
+  int i, clipped = mu_check_clip(ctx, expand_rect(rect, border));
+  if (clipped == MU_CLIP_ALL) { return; }
+  /* a single frame command is only used if the renderer supports it and no
+  ** part of it needs clipping; otherwise it is drawn as a rect and boxes */
+  if (border && !clipped && ctx->caps & MU_CAP_FRAME) {
+    cmd = mu_push_command(ctx, MU_COMMAND_FRAME, sizeof(mu_FrameCommand));
+    cmd->frame.rect = local_rect(ctx, rect);
+    cmd->frame.color = color;
+    cmd->frame.border_color = border_color;
+    cmd->frame.border = border;
+    return;
+  }
+  mu_draw_rect(ctx, rect, color);
+  for (i = 1; i <= border; i++) {
+    mu_draw_box(ctx, expand_rect(rect, i), border_color);
+  }
+}
+
+
+#define MAX_TEXT_SIZE ((int) (MU_MAX_COMMAND_SIZE - sizeof(mu_TextCommand)))
+
+static void draw_text(mu_Context *ctx, mu_Font font, const char *str, int len,
+  mu_Vec2 pos, mu_Color color, int ref)
 {
   mu_Command *cmd;
-  mu_Rect rect = mu_rect(
+  mu_Rect rect;
+  int clipped, n;
+  if (len < 0) { len = strlen(str); }
+  /* text longer than a command can hold is drawn in pieces, split between
+  ** UTF-8 sequences */
+  while (!ref && len > MAX_TEXT_SIZE) {
+    for (n = MAX_TEXT_SIZE; n > 1 && (str[n] & 0xc0) == 0x80; n--);
+    draw_text(ctx, font, str, n, pos, color, 0);
+    pos.x += ctx->text_width(font, str, n);
+    str += n;
+    len -= n;
+  }
+  rect = mu_rect(
     pos.x, pos.y, ctx->text_width(font, str, len), ctx->text_height(font));
-  int clipped = mu_check_clip(ctx, rect);
+  clipped = mu_check_clip(ctx, rect);
   if (clipped == MU_CLIP_ALL ) { return; }
   if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
   /* add command */
-  if (len < 0) { len = strlen(str); }
-  cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand) + len);
-  memcpy(cmd->text.str, str, len);
-  cmd->text.str[len] = '\0';
-  cmd->text.pos = pos;
-  cmd->text.color = color;
-  cmd->text.font = font;
+  if (ref) {
+    cmd = mu_push_command(ctx, MU_COMMAND_TEXTREF, sizeof(mu_TextRefCommand));
+    cmd->textref.str = str;
+    cmd->textref.len = len;
+    cmd->textref.width = rect.w;
+    cmd->textref.pos = local_vec2(ctx, pos);
+    cmd->textref.color = color;
+    cmd->textref.font = font;
+  } else {
+    cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand) + len);
+    memcpy(cmd->text.str, str, len);
+    cmd->text.str[len] = '\0';
+    cmd->text.width = rect.w;
+    cmd->text.pos = local_vec2(ctx, pos);
+    cmd->text.color = color;
+    cmd->text.font = font;
+  }
   /* reset clipping if it was set */
   if (clipped) { mu_set_clip(ctx, unclipped_rect); }
 }
 
 
+void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len,
+  mu_Vec2 pos, mu_Color color)
+{
+  draw_text(ctx, font, str, len, pos, color, 0);
+}
+
+
+void mu_draw_text_ref(mu_Context *ctx, mu_Font font, const char *str, int len,
+  mu_Vec2 pos, mu_Color color)
+{
+  /* the string is copied if the renderer can't take a reference */
+  draw_text(ctx, font, str, len, pos, color, ctx->caps & MU_CAP_TEXTREF);
+}
+
+
+void mu_draw_text_spans(mu_Context *ctx, mu_Font font, const char *str,
+  int len, mu_Vec2 pos, const mu_TextSpan *spans, int count)
+{
+  mu_Command *cmd;
+  mu_Rect rect;
+  int i, clipped, size;
+  if (len < 0) { len = strlen(str); }
+  if (count <= 0) { return; }
+  size = sizeof(mu_TextSpansCommand) + (count - 1) * sizeof(mu_TextSpan)
+    + len + 1;
+  /* without renderer support, or if they don't fit in one command, each
+  ** span is drawn as its own text command */
+  if (~ctx->caps & MU_CAP_TEXTSPANS || size > MU_MAX_COMMAND_SIZE) {
+    for (i = 0; i < count; i++) {
+      int start = (i == 0) ? 0 : spans[i].offset;
+      int end = (i == count - 1) ? len : spans[i + 1].offset;
+      if (end <= start) { continue; }
+      mu_draw_text(ctx, font, str + start, end - start, pos, spans[i].color);
+      pos.x += ctx->text_width(font, str + start, end - start);
+    }
+    return;
+  }
+  rect = mu_rect(
+    pos.x, pos.y, ctx->text_width(font, str, len), ctx->text_height(font));
+  clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL ) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  cmd = mu_push_command(ctx, MU_COMMAND_TEXTSPANS, size);
+  cmd->textspans.pos = local_vec2(ctx, pos);
+  cmd->textspans.font = font;
+  cmd->textspans.width = rect.w;
+  cmd->textspans.len = len;
+  cmd->textspans.count = count;
+  memcpy(cmd->textspans.spans, spans, count * sizeof(mu_TextSpan));
+  cmd->textspans.spans[0].offset = 0;
+  memcpy(cmd->textspans.spans + count, str, len);
+  ((char*) (cmd->textspans.spans + count))[len] = '\0';
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+const char* mu_textspans_str(mu_Command *cmd) {
+  return (const char*) (cmd->textspans.spans + cmd->textspans.count);
+}
+
+
+/* the payload of a custom command starts at the next 8 byte boundary after
+** its header */
+#define CUSTOM_HEADER_SIZE ((sizeof(mu_CustomCommand) + 7) & ~7)
+
+int mu_register_command(mu_Context *ctx, int payload_size) {
+  expect(payload_size >= 0);
+  expect(payload_size <= (int) (MU_MAX_COMMAND_SIZE - CUSTOM_HEADER_SIZE));
+  push(ctx->command_types, payload_size);
+  return MU_COMMAND_CUSTOM + ctx->command_types.idx - 1;
+}
+
+
+void* mu_push_custom_command(mu_Context *ctx, int type, mu_Rect rect) {
+  mu_Command *cmd;
+  int clipped, i = type - MU_COMMAND_CUSTOM;
+  expect(i >= 0 && i < ctx->command_types.idx);
+  /* the rect is used for clipping, culling and damage; a partially clipped
+  ** command is wrapped in clip commands like an icon */
+  clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL ) { return NULL; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  cmd = mu_push_command(ctx, type,
+    CUSTOM_HEADER_SIZE + ctx->command_types.items[i]);
+  cmd->custom.rect = local_rect(ctx, rect);
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+  return mu_command_payload(cmd);
+}
+
+
+void* mu_command_payload(mu_Command *cmd) {
+  return (char*) cmd + CUSTOM_HEADER_SIZE;
+}
+
+
 void mu_draw_icon(mu_Context *ctx, int id, mu_Rect rect, mu_Color color) {
   mu_Command *cmd;
   /* do clip command if the rect isn't fully contained within the cliprect */
@@ -536,13 +1764,246 @@ void mu_draw_icon(mu_Context *ctx, int id, mu_Rect rect, mu_Color color) {
   /* do icon command */
   cmd = mu_push_command(ctx, MU_COMMAND_ICON, sizeof(mu_IconCommand));
   cmd->icon.id = id;
-  cmd->icon.rect = rect;
+  cmd->icon.rect = local_rect(ctx, rect);
   cmd->icon.color = color;
   /* reset clipping if it was set */
   if (clipped) { mu_set_clip(ctx, unclipped_rect); }
 }
 
 
+static void draw_sprite_batch(mu_Context *ctx, const int *ids,
+  const mu_Rect *rects, const mu_Color *colors, int count)
+{
+  mu_Command *cmd;
+  mu_Rect clip = mu_get_clip_rect(ctx), bounds = mu_rect(0, 0, 0, 0);
+  int i, n = 0, clipped = 0;
+  /* sprites outside the clip rect are dropped; if any of the rest cross it
+  ** the whole batch is clipped */
+  for (i = 0; i < count; i++) {
+    mu_Rect r = rects[i], v = intersect_rects(r, clip);
+    if (v.w == 0 || v.h == 0) { continue; }
+    if (!rect_equals(v, r)) { clipped = 1; }
+    bounds = n++ ? union_rects(bounds, r) : r;
+  }
+  if (n == 0) { return; }
+  if (clipped) { mu_set_clip(ctx, clip); }
+  cmd = mu_push_command(ctx, MU_COMMAND_SPRITES,
+    sizeof(mu_SpritesCommand) + (n - 1) * sizeof(mu_Sprite));
+  cmd->sprites.rect = local_rect(ctx, bounds);
+  cmd->sprites.count = n;
+  for (i = 0, n = 0; i < count; i++) {
+    mu_Rect v = intersect_rects(rects[i], clip);
+    if (v.w == 0 || v.h == 0) { continue; }
+    cmd->sprites.sprites[n].rect = local_rect(ctx, rects[i]);
+    cmd->sprites.sprites[n].id = ids[i];
+    cmd->sprites.sprites[n].color = colors[i];
+    n++;
+  }
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+void mu_draw_sprites(mu_Context *ctx, const int *ids, const mu_Rect *rects,
+  const mu_Color *colors, int count)
+{
+  int i;
+  /* without renderer support each sprite is drawn as an icon */
+  if (~ctx->caps & MU_CAP_SPRITES) {
+    for (i = 0; i < count; i++) {
+      mu_draw_icon(ctx, ids[i], rects[i], colors[i]);
+    }
+    return;
+  }
+  for (i = 0; i < count; i += MU_SPRITEBATCH_SIZE) {
+    draw_sprite_batch(ctx, ids + i, rects + i, colors + i,
+      mu_min(count - i, MU_SPRITEBATCH_SIZE));
+  }
+}
+
+
+void mu_draw_image(mu_Context *ctx, mu_Image image, mu_Rect rect, mu_Rect uv) {
+  mu_Command *cmd;
+  int clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL ) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  /* `uv` is in the image's pixels and isn't moved by the origin */
+  cmd = mu_push_command(ctx, MU_COMMAND_IMAGE, sizeof(mu_ImageCommand));
+  cmd->image.image = image;
+  cmd->image.rect = local_rect(ctx, rect);
+  cmd->image.uv = encode_rect(uv);
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+static void draw_segment(mu_Context *ctx, mu_Vec2 a, mu_Vec2 b, int skip,
+  mu_Color color)
+{
+  /* `skip` leaves out the first pixel, which the previous segment has drawn */
+  mu_Rect r;
+  int i = skip;
+  while (next_segment_run(a, b, &i, &r)) { mu_draw_rect(ctx, r, color); }
+}
+
+
+static mu_Rect polyline_rect(const mu_Vec2 *points, int count) {
+  int i, x1, y1, x2, y2;
+  x1 = x2 = points[0].x;
+  y1 = y2 = points[0].y;
+  for (i = 1; i < count; i++) {
+    x1 = mu_min(x1, points[i].x); x2 = mu_max(x2, points[i].x);
+    y1 = mu_min(y1, points[i].y); y2 = mu_max(y2, points[i].y);
+  }
+  return mu_rect(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
+
+static void draw_polyline_batch(mu_Context *ctx, const mu_Vec2 *points,
+  int count, mu_Color color)
+{
+  mu_Command *cmd;
+  mu_Rect rect = polyline_rect(points, count);
+  int i, clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL ) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  cmd = mu_push_command(ctx, MU_COMMAND_POLYLINE, sizeof(mu_PolylineCommand)
+    + (count - 1) * sizeof(mu_CmdVec2));
+  cmd->polyline.rect = local_rect(ctx, rect);
+  cmd->polyline.color = color;
+  cmd->polyline.count = count;
+  for (i = 0; i < count; i++) {
+    cmd->polyline.points[i] = local_vec2(ctx, points[i]);
+  }
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+void mu_draw_polyline(mu_Context *ctx, const mu_Vec2 *points, int count,
+  mu_Color color)
+{
+  int i;
+  if (count <= 0) { return; }
+  /* without renderer support the line is drawn as rects, one per run of
+  ** pixels */
+  if (~ctx->caps & MU_CAP_POLYLINE) {
+    if (mu_check_clip(ctx, polyline_rect(points, count)) == MU_CLIP_ALL) {
+      return;
+    }
+    for (i = 0; i < count; i++) {
+      draw_segment(ctx, points[i ? i - 1 : 0], points[i], i > 0, color);
+    }
+    return;
+  }
+  /* long lines are split every MU_POLYLINE_SIZE points, each part starting
+  ** at the point the last one ended on */
+  for (i = 0; i == 0 || i < count - 1; i += MU_POLYLINE_SIZE - 1) {
+    draw_polyline_batch(ctx, points + i, mu_min(count - i, MU_POLYLINE_SIZE),
+      color);
+  }
+}
+
+
+static void draw_glyph_row(mu_Context *ctx, mu_Font font,
+  const mu_GlyphCell *cells, int cols, mu_Vec2 pos, int cell_w, int cell_h,
+  const mu_Color *palette)
+{
+  char buf[MU_MAX_FMT + 1];
+  int i, j, n;
+  /* one rect per run of equal backgrounds */
+  for (i = 0; i < cols; i = j) {
+    for (j = i + 1; j < cols && cells[j].bg == cells[i].bg; j++);
+    if (palette[cells[i].bg].a) {
+      mu_draw_rect(ctx, mu_rect(pos.x + i * cell_w, pos.y, (j - i) * cell_w,
+        cell_h), palette[cells[i].bg]);
+    }
+  }
+  /* one text command per run of equal foregrounds; blanks join any run */
+  for (i = 0; i < cols; i = j) {
+    if (cells[i].chr <= ' ') { j = i + 1; continue; }
+    for (n = 0, j = i; j < cols && n < MU_MAX_FMT; j++, n++) {
+      if (cells[j].chr > ' ' && cells[j].fg != cells[i].fg) { break; }
+      buf[n] = cells[j].chr > ' ' ? cells[j].chr : ' ';
+    }
+    while (buf[n - 1] == ' ') { n--; j--; }
+    mu_draw_text(ctx, font, buf, n, mu_vec2(pos.x + i * cell_w, pos.y),
+      palette[cells[i].fg]);
+  }
+}
+
+
+/* the most cells a glyph grid command can hold */
+#define MAX_GLYPH_CELLS ((int) ((MU_MAX_COMMAND_SIZE \
+  - sizeof(mu_GlyphGridCommand)) / sizeof(mu_GlyphCell) + 1))
+
+static void draw_glyph_band(mu_Context *ctx, mu_Font font,
+  const mu_GlyphCell *cells, int stride, int cols, int rows, mu_Vec2 pos,
+  int cell_w, int cell_h, const mu_Color *palette)
+{
+  mu_Command *cmd;
+  mu_Rect clip = mu_get_clip_rect(ctx);
+  int i, clipped = mu_check_clip(ctx, mu_rect(pos.x, pos.y, cols * cell_w,
+    rows * cell_h));
+  if (clipped == MU_CLIP_ALL ) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, clip); }
+  cmd = mu_push_command(ctx, MU_COMMAND_GLYPHGRID, sizeof(mu_GlyphGridCommand)
+    + (cols * rows - 1) * sizeof(mu_GlyphCell));
+  cmd->glyphgrid.pos = local_vec2(ctx, pos);
+  cmd->glyphgrid.font = font;
+  cmd->glyphgrid.cols = cols;
+  cmd->glyphgrid.rows = rows;
+  cmd->glyphgrid.cell_w = cell_w;
+  cmd->glyphgrid.cell_h = cell_h;
+  memcpy(cmd->glyphgrid.palette, palette, sizeof(cmd->glyphgrid.palette));
+  for (i = 0; i < rows; i++) {
+    memcpy(cmd->glyphgrid.cells + i * cols, cells + i * stride,
+      cols * sizeof(mu_GlyphCell));
+  }
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+void mu_draw_glyph_grid(mu_Context *ctx, mu_Font font,
+  const mu_GlyphCell *cells, int cols, int rows, mu_Vec2 pos,
+  const mu_Color *palette)
+{
+  mu_Rect clip = mu_get_clip_rect(ctx);
+  int cell_w = ctx->text_width(font, "M", 1);
+  int cell_h = ctx->text_height(font);
+  int i, j, clipped, first, last, band_w, band_h;
+  if (cols <= 0 || rows <= 0 || cell_w <= 0 || cell_h <= 0) { return; }
+  /* the font is taken to be monospace; rows outside the clip rect are left
+  ** out */
+  first = mu_max(0, (clip.y - pos.y) / cell_h);
+  last = mu_min(rows, (clip.y + clip.h - pos.y + cell_h - 1) / cell_h);
+  if (first >= last) { return; }
+  cells += first * cols;
+  pos.y += first * cell_h;
+  rows = last - first;
+  clipped = mu_check_clip(ctx, mu_rect(pos.x, pos.y, cols * cell_w,
+    rows * cell_h));
+  if (clipped == MU_CLIP_ALL) { return; }
+  /* without renderer support rows are drawn as rects and text runs */
+  if (~ctx->caps & MU_CAP_GLYPHGRID) {
+    for (i = 0; i < rows; i++) {
+      draw_glyph_row(ctx, font, cells + i * cols, cols,
+        mu_vec2(pos.x, pos.y + i * cell_h), cell_w, cell_h, palette);
+    }
+    return;
+  }
+  /* a grid with more cells than a command can hold is split into bands of
+  ** whole rows, and rows too long on their own are split into columns */
+  band_w = mu_min(cols, MAX_GLYPH_CELLS);
+  band_h = MAX_GLYPH_CELLS / band_w;
+  for (i = 0; i < rows; i += band_h) {
+    for (j = 0; j < cols; j += band_w) {
+      draw_glyph_band(ctx, font, cells + i * cols + j, cols,
+        mu_min(cols - j, band_w), mu_min(rows - i, band_h),
+        mu_vec2(pos.x + j * cell_w, pos.y + i * cell_h), cell_w, cell_h,
+        palette);
+    }
+  }
+}
+
+
 /*============================================================================
 ** layout
 **============================================================================*/
@@ -687,7 +2148,11 @@ void mu_draw_control_text(mu_Context *ctx, const char *str, mu_Rect rect,
   } else {
     pos.x = rect.x + ctx->style->padding;
   }
-  mu_draw_text(ctx, font, str, -1, pos, ctx->style->colors[colorid]);
+  if (opt & MU_OPT_TEXTREF) {
+    mu_draw_text_ref(ctx, font, str, -1, pos, ctx->style->colors[colorid]);
+  } else {
+    mu_draw_text(ctx, font, str, -1, pos, ctx->style->colors[colorid]);
+  }
   mu_pop_clip_rect(ctx);
 }
 
@@ -731,16 +2196,57 @@ void mu_update_control(mu_Context *ctx, mu_Id id, mu_Rect rect, int opt) {
 }
 
 
-void mu_text(mu_Context *ctx, const char *text) {
+static void draw_text_block(mu_Context *ctx, mu_Font font, const char *text,
+  mu_TextLine *lines, int n, mu_Vec2 pos, int width, int line_height,
+  mu_Color color, int ref)
+{
+  mu_Command *cmd;
+  int i, clipped, base, len, size;
+  if (n == 0) { return; }
+  /* lines outside the clip rect were already left out */
+  clipped = mu_check_clip(ctx, mu_rect(pos.x, pos.y, width,
+    (n - 1) * line_height + ctx->text_height(font)));
+  if (clipped) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  /* the text is stored after the lines unless it is referenced */
+  base = ref ? 0 : lines[0].start;
+  len = ref ? 0 : lines[n - 1].end - base;
+  size = sizeof(mu_TextBlockCommand) + (n - 1) * sizeof(mu_TextLine) + len;
+  cmd = mu_push_command(ctx, MU_COMMAND_TEXTBLOCK, size);
+  cmd->textblock.pos = local_vec2(ctx, pos);
+  cmd->textblock.font = font;
+  cmd->textblock.str = ref ? text : NULL;
+  cmd->textblock.width = width;
+  cmd->textblock.line_height = line_height;
+  cmd->textblock.count = n;
+  cmd->textblock.color = color;
+  for (i = 0; i < n; i++) {
+    cmd->textblock.lines[i].start = lines[i].start - base;
+    cmd->textblock.lines[i].end = lines[i].end - base;
+  }
+  memcpy(cmd->textblock.lines + n, text + base, len);
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+
+const char* mu_textblock_str(mu_Command *cmd) {
+  mu_TextBlockCommand *tb = &cmd->textblock;
+  return tb->str ? tb->str : (const char*) (tb->lines + tb->count);
+}
+
+
+void mu_text_ex(mu_Context *ctx, const char *text, int opt) {
   const char *start, *end, *p = text;
-  int width = -1;
+  int width = -1, n = 0, block_w = 0, line_h = 0;
+  int ref = (opt & MU_OPT_TEXTREF) && (ctx->caps & MU_CAP_TEXTREF);
   mu_Font font = ctx->style->font;
   mu_Color color = ctx->style->colors[MU_COLOR_TEXT];
+  mu_TextLine lines[MU_TEXTBLOCK_LINES];
+  mu_Vec2 pos = mu_vec2(0, 0);
   mu_layout_begin_column(ctx);
   mu_layout_row(ctx, 1, &width, ctx->text_height(font));
   do {
     mu_Rect r = mu_layout_next(ctx);
-    int w = 0;
+    int w = 0, hidden;
     start = end = p;
     do {
       const char* word = p;
@@ -750,21 +2256,116 @@ void mu_text(mu_Context *ctx, const char *text) {
       w += ctx->text_width(font, p, 1);
       end = p++;
     } while (*end && *end != '\n');
-    mu_draw_text(ctx, font, start, end - start, mu_vec2(r.x, r.y), color);
     p = end + 1;
+    if (~ctx->caps & MU_CAP_TEXTBLOCK) {
+      if (opt & MU_OPT_TEXTREF) {
+        mu_draw_text_ref(ctx, font, start, end - start, mu_vec2(r.x, r.y), color);
+      } else {
+        mu_draw_text(ctx, font, start, end - start, mu_vec2(r.x, r.y), color);
+      }
+      continue;
+    }
+    /* gather runs of evenly spaced visible lines into block commands */
+    r.w = ctx->text_width(font, start, end - start);
+    r.h = ctx->text_height(font);
+    hidden = mu_check_clip(ctx, r) == MU_CLIP_ALL;
+    if (n > 0 && (hidden || n == MU_TEXTBLOCK_LINES ||
+        (n > 1 && r.y != pos.y + n * line_h))
+    ) {
+      draw_text_block(ctx, font, text, lines, n, pos, block_w, line_h, color, ref);
+      n = 0;
+    }
+    if (hidden) { continue; }
+    if (n == 0) { pos = mu_vec2(r.x, r.y); block_w = 0; }
+    if (n == 1) { line_h = r.y - pos.y; }
+    lines[n].start = start - text;
+    lines[n].end = end - text;
+    block_w = mu_max(block_w, r.w);
+    n++;
   } while (*end);
+  draw_text_block(ctx, font, text, lines, n, pos, block_w, line_h, color, ref);
   mu_layout_end_column(ctx);
 }
 
 
-void mu_label(mu_Context *ctx, const char *text) {
-  mu_draw_control_text(ctx, text, mu_layout_next(ctx), MU_COLOR_TEXT, 0);
+void mu_label_ex(mu_Context *ctx, const char *text, int opt) {
+  mu_draw_control_text(ctx, text, mu_layout_next(ctx), MU_COLOR_TEXT, opt);
+}
+
+
+void mu_console_init(mu_Console *con, mu_GlyphCell *cells, int cols, int rows) {
+  con->cells = cells;
+  con->cols = cols;
+  con->rows = rows;
+  con->fg = 7;
+  con->bg = 0;
+  memcpy(con->palette, default_palette, sizeof(con->palette));
+  mu_console_clear(con);
+}
+
+
+void mu_console_clear(mu_Console *con) {
+  int i;
+  for (i = 0; i < con->cols * con->rows; i++) {
+    con->cells[i].chr = ' ';
+    con->cells[i].fg = con->fg;
+    con->cells[i].bg = con->bg;
+  }
+  con->cursor_x = con->cursor_y = 0;
+}
+
+
+static void console_newline(mu_Console *con) {
+  int i, n = con->cols;
+  con->cursor_x = 0;
+  if (++con->cursor_y < con->rows) { return; }
+  /* scroll everything up a row and blank the last one */
+  con->cursor_y = con->rows - 1;
+  memmove(con->cells, con->cells + n, (con->rows - 1) * n * sizeof(mu_GlyphCell));
+  for (i = 0; i < n; i++) {
+    mu_GlyphCell *c = &con->cells[con->cursor_y * n + i];
+    c->chr = ' '; c->fg = con->fg; c->bg = con->bg;
+  }
+}
+
+
+static void console_put(mu_Console *con, int chr) {
+  mu_GlyphCell *c;
+  if (con->cursor_x == con->cols) { console_newline(con); }
+  c = &con->cells[con->cursor_y * con->cols + con->cursor_x++];
+  c->chr = chr;
+  c->fg = con->fg;
+  c->bg = con->bg;
+}
+
+
+void mu_console_write(mu_Console *con, const char *str) {
+  for (; *str; str++) {
+    switch (*str) {
+      case '\n': console_newline(con); break;
+      case '\r': con->cursor_x = 0; break;
+      case '\t': do { console_put(con, ' '); } while (con->cursor_x % 8); break;
+      default: console_put(con, *str); break;
+    }
+  }
+}
+
+
+void mu_console(mu_Context *ctx, mu_Console *con) {
+  mu_Font font = ctx->style->font;
+  mu_Rect r = mu_layout_next(ctx);
+  int h = con->rows * ctx->text_height(font);
+  /* if the rect is too short, the rows with the cursor are kept in view */
+  mu_push_clip_rect(ctx, r);
+  mu_draw_glyph_grid(ctx, font, con->cells, con->cols, con->rows,
+    mu_vec2(r.x, r.y + mu_min(0, r.h - h)), con->palette);
+  mu_pop_clip_rect(ctx);
 }
 
 
 int mu_button_ex(mu_Context *ctx, const char *label, int icon, int opt) {
   int res = 0;
-  mu_Id id = label ? mu_get_id(ctx, label, strlen(label))
+  mu_Id id = label ? label_id(ctx, label)
                    : mu_get_id(ctx, &icon, sizeof(icon));
   mu_Rect r = mu_layout_next(ctx);
   int was_active = (ctx->active_id == id);
@@ -916,9 +2517,9 @@ int mu_slider_ex(mu_Context *ctx, mu_Real *value, mu_Real low, mu_Real high,
   x = (v - low) * (base.w - w) / (high - low);
   thumb = mu_rect(base.x + x, base.y, w, base.h);
   mu_draw_control_frame(ctx, id, thumb, MU_COLOR_BUTTON, opt);
-  /* draw text */
+  /* draw text; it is in a local buffer, so it is always copied */
   sprintf(buf, fmt, v);
-  mu_draw_control_text(ctx, buf, base, MU_COLOR_TEXT, opt);
+  mu_draw_control_text(ctx, buf, base, MU_COLOR_TEXT, opt & ~MU_OPT_TEXTREF);
 
   return res;
 }
@@ -948,9 +2549,9 @@ int mu_number_ex(mu_Context *ctx, mu_Real *value, mu_Real step,
 
   /* draw base */
   mu_draw_control_frame(ctx, id, base, MU_COLOR_BASE, opt);
-  /* draw text  */
+  /* draw text; it is in a local buffer, so it is always copied */
   sprintf(buf, fmt, *value);
-  mu_draw_control_text(ctx, buf, base, MU_COLOR_TEXT, opt);
+  mu_draw_control_text(ctx, buf, base, MU_COLOR_TEXT, opt & ~MU_OPT_TEXTREF);
 
   return res;
 }
@@ -959,8 +2560,8 @@ int mu_number_ex(mu_Context *ctx, mu_Real *value, mu_Real step,
 static int header(mu_Context *ctx, const char *label, int istreenode, int opt) {
   mu_Rect r;
   int active, expanded;
-  mu_Id id = mu_get_id(ctx, label, strlen(label));
-  int idx = mu_pool_get(ctx, ctx->treenode_pool, MU_TREENODEPOOL_SIZE, id);
+  mu_Id id = label_id(ctx, label);
+  int idx = mu_pool_get(ctx, &ctx->treenode_pool, id);
   int width = -1;
   mu_layout_row(ctx, 1, &width, 0);
 
@@ -980,10 +2581,10 @@ static int header(mu_Context *ctx, const char *label, int istreenode, int opt) {
 
   /* update pool ref */
   if (idx >= 0) {
-    if (active) { mu_pool_update(ctx, ctx->treenode_pool, idx); }
-           else { memset(&ctx->treenode_pool[idx], 0, sizeof(mu_PoolItem)); }
+    if (active) { mu_pool_update(ctx, &ctx->treenode_pool, idx); }
+           else { mu_pool_remove(ctx, &ctx->treenode_pool, idx); }
   } else if (active) {
-    mu_pool_init(ctx, ctx->treenode_pool, MU_TREENODEPOOL_SIZE, id);
+    mu_pool_init(ctx, &ctx->treenode_pool, id);
   }
 
   /* draw */
@@ -1086,16 +2687,21 @@ static void push_container_body(
   mu_Context *ctx, mu_Container *cnt, mu_Rect body, int opt
 ) {
   if (~opt & MU_OPT_NOSCROLL) { scrollbars(ctx, cnt, &body); }
+  /* the contents are placed relative to the scrolled body */
+  set_origin(ctx, mu_vec2(body.x - cnt->scroll.x, body.y - cnt->scroll.y), 0);
   push_layout(ctx, expand_rect(body, -ctx->style->padding), cnt->scroll);
   cnt->body = body;
 }
 
 
 static void begin_root_container(mu_Context *ctx, mu_Container *cnt) {
-  push(ctx->container_stack, cnt);
+  push_container(ctx, cnt);
   /* push container to roots list and push head command */
   push(ctx->root_list, cnt);
   cnt->head = push_jump(ctx, NULL);
+  /* root containers are drawn in z-order rather than the order they were
+  ** made in, so each starts by setting its origin */
+  set_origin(ctx, mu_vec2(cnt->rect.x, cnt->rect.y), 1);
   /* set as hover root if the mouse is overlapping this container and it has a
   ** higher zindex than the current hover root */
   if (rect_overlaps_vec2(cnt->rect, ctx->mouse_pos) &&
@@ -1115,7 +2721,7 @@ static void end_root_container(mu_Context *ctx) {
   ** on initing these are done in mu_end() */
   mu_Container *cnt = mu_get_current_container(ctx);
   cnt->tail = push_jump(ctx, NULL);
-  cnt->head->jump.dst = ctx->command_list.items + ctx->command_list.idx;
+  cnt->head->jump.dst = command_end(&ctx->buffer->commands);
   /* pop base clip rect and container */
   mu_pop_clip_rect(ctx);
   pop_container(ctx);
@@ -1124,7 +2730,7 @@ static void end_root_container(mu_Context *ctx) {
 
 int mu_begin_window_ex(mu_Context *ctx, const char *title, mu_Rect rect, int opt) {
   mu_Rect body;
-  mu_Id id = mu_get_id(ctx, title, strlen(title));
+  mu_Id id = label_id(ctx, title);
   mu_Container *cnt = get_container(ctx, id, opt);
   if (!cnt || !cnt->open) { return 0; }
   push(ctx->id_stack, id);
@@ -1269,13 +2875,13 @@ void mu_end_popup(mu_Context *ctx) {
 
 void mu_begin_panel_ex(mu_Context *ctx, const char *name, int opt) {
   mu_Container *cnt;
-  mu_push_id(ctx, name, strlen(name));
+  push(ctx->id_stack, label_id(ctx, name));
   cnt = get_container(ctx, ctx->last_id, opt);
   cnt->rect = mu_layout_next(ctx);
   if (~opt & MU_OPT_NOFRAME) {
     ctx->draw_frame(ctx, cnt->rect, MU_COLOR_PANELBG, 1);
   }
-  push(ctx->container_stack, cnt);
+  push_container(ctx, cnt);
   push_container_body(ctx, cnt, cnt->rect, opt);
   mu_push_clip_rect(ctx, cnt->body);
 }
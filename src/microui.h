@@ -10,7 +10,7 @@
 
 #define MU_VERSION "2.02"
 
-#define MU_COMMANDLIST_SIZE     (256 * 1024)
+#define MU_COMMANDCHUNK_SIZE    (16 * 1024)
 #define MU_ROOTLIST_SIZE        32
 #define MU_CONTAINERSTACK_SIZE  32
 #define MU_CLIPSTACK_SIZE       32
@@ -19,6 +19,12 @@
 #define MU_CONTAINERPOOL_SIZE   48
 #define MU_TREENODEPOOL_SIZE    48
 #define MU_MAX_WIDTHS           64
+#define MU_TEXTBLOCK_LINES      64
+#define MU_COMMANDTYPES_SIZE    16
+#define MU_PALETTE_SIZE         16
+#define MU_SPRITEBATCH_SIZE     1024
+#define MU_POLYLINE_SIZE        4096
+#define MU_COMMANDBUFFERS       3
 #define MU_REAL                 float
 #define MU_REAL_FMT             "%.3g"
 #define MU_SLIDER_FMT           "%.2f"
@@ -44,8 +50,29 @@ enum {
   MU_COMMAND_RECT,
   MU_COMMAND_TEXT,
   MU_COMMAND_ICON,
+  MU_COMMAND_FRAME,
+  MU_COMMAND_ORIGIN,
+  MU_COMMAND_TEXTREF,
+  MU_COMMAND_TEXTBLOCK,
+  MU_COMMAND_TEXTSPANS,
+  MU_COMMAND_POLYLINE,
+  MU_COMMAND_GLYPHGRID,
+  MU_COMMAND_IMAGE,
+  MU_COMMAND_SPRITES,
   MU_COMMAND_MAX,
-  MU_COMMAND_INPUT
+  MU_COMMAND_INPUT,
+  MU_COMMAND_CUSTOM /* first type returned by mu_register_command() */
+};
+
+enum {
+  MU_CAP_FRAME        = (1 << 0),
+  MU_CAP_ORIGIN       = (1 << 1),
+  MU_CAP_TEXTREF      = (1 << 2),
+  MU_CAP_TEXTBLOCK    = (1 << 3),
+  MU_CAP_TEXTSPANS    = (1 << 4),
+  MU_CAP_POLYLINE     = (1 << 5),
+  MU_CAP_GLYPHGRID    = (1 << 6),
+  MU_CAP_SPRITES      = (1 << 7)
 };
 
 enum {
@@ -95,7 +122,8 @@ enum {
   MU_OPT_CLOSED       = (1 << 11),
   MU_OPT_EXPANDED     = (1 << 12),
   MU_OPT_NOBORDER     = (1 << 13),
-  MU_OPT_ANCHORED     = (1 << 14)
+  MU_OPT_ANCHORED     = (1 << 14),
+  MU_OPT_TEXTREF      = (1 << 15)
 };
 
 enum {
@@ -104,6 +132,16 @@ enum {
   MU_MOUSE_MIDDLE     = (1 << 2)
 };
 
+enum {
+  MU_INPUT_MOUSEMOVE = 1,
+  MU_INPUT_MOUSEDOWN,
+  MU_INPUT_MOUSEUP,
+  MU_INPUT_SCROLL,
+  MU_INPUT_KEYDOWN,
+  MU_INPUT_KEYUP,
+  MU_INPUT_TEXT
+};
+
 enum {
   MU_KEY_SHIFT        = (1 << 0),
   MU_KEY_CTRL         = (1 << 1),
@@ -114,25 +152,71 @@ enum {
 
 
 typedef struct mu_Context mu_Context;
+typedef struct mu_CommandChunk mu_CommandChunk;
+#ifdef MU_ID32
 typedef unsigned mu_Id;
+#else
+typedef uint64_t mu_Id;
+#endif
 typedef MU_REAL mu_Real;
 typedef void* mu_Font;
+typedef int mu_Image;
 
 typedef struct { int x, y; } mu_Vec2;
 typedef struct { int x, y, w, h; } mu_Rect;
 typedef struct { unsigned char r, g, b, a; } mu_Color;
-typedef struct { mu_Id id; int last_update; } mu_PoolItem;
+typedef struct { mu_Id id; int last_update; int prev, next; } mu_PoolItem;
+
+typedef struct {
+  mu_PoolItem *items;
+  int *index; /* open-addressing slots holding `item + 1`, 0 if empty */
+  int len;    /* item count; `index` must hold `len * 2` slots */
+  int head;   /* least recently updated item, first to be evicted */
+  int tail;   /* most recently updated item */
+} mu_Pool;
+
+/* with MU_COMPACT_COMMANDS defined commands store 16-bit headers and
+** geometry; renderers read geometry through `mu_decode_rect()` and
+** `mu_decode_vec2()`, which work in either mode */
+#ifdef MU_COMPACT_COMMANDS
+typedef short mu_CommandType;
+typedef struct { mu_CommandType type; unsigned short size; } mu_BaseCommand;
+typedef struct { short x, y; } mu_CmdVec2;
+typedef struct { short x, y; unsigned short w, h; } mu_CmdRect;
+#define MU_MAX_COMMAND_SIZE     0xfff8
+#else
+typedef int mu_CommandType;
+typedef struct { mu_CommandType type; int size; } mu_BaseCommand;
+typedef mu_Vec2 mu_CmdVec2;
+typedef mu_Rect mu_CmdRect;
+#define MU_MAX_COMMAND_SIZE     0x7ffffff8
+#define mu_decode_rect(r)       (r)
+#define mu_decode_vec2(v)       (v)
+#endif
 
-typedef struct { int type, size; } mu_BaseCommand;
 typedef struct { mu_BaseCommand base; void *dst; } mu_JumpCommand;
-typedef struct { mu_BaseCommand base; mu_Rect rect; } mu_ClipCommand;
-typedef struct { mu_BaseCommand base; mu_Rect rect; mu_Color color; } mu_RectCommand;
-typedef struct { mu_BaseCommand base; mu_Font font; mu_Vec2 pos; mu_Color color; char str[1]; } mu_TextCommand;
-typedef struct { mu_BaseCommand base; mu_Rect rect; int id; mu_Color color; } mu_IconCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; } mu_ClipCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; mu_Color color; } mu_RectCommand;
+typedef struct { mu_BaseCommand base; mu_Font font; mu_CmdVec2 pos; mu_Color color; int width; char str[1]; } mu_TextCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; int id; mu_Color color; } mu_IconCommand;
 typedef struct { mu_BaseCommand base; uint8_t status; } mu_InptCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; mu_Color color, border_color; int border; } mu_FrameCommand;
+typedef struct { mu_BaseCommand base; mu_Vec2 pos; } mu_OriginCommand;
+typedef struct { mu_BaseCommand base; mu_CmdVec2 pos; mu_Font font; const char *str; int len, width; mu_Color color; } mu_TextRefCommand;
+typedef struct { int start, end; } mu_TextLine;
+typedef struct { mu_BaseCommand base; mu_CmdVec2 pos; mu_Font font; const char *str; int width, line_height, count; mu_Color color; mu_TextLine lines[1]; } mu_TextBlockCommand;
+typedef struct { int offset; mu_Color color; } mu_TextSpan;
+typedef struct { mu_BaseCommand base; mu_CmdVec2 pos; mu_Font font; int width, len, count; mu_TextSpan spans[1]; } mu_TextSpansCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; mu_Color color; int count; mu_CmdVec2 points[1]; } mu_PolylineCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; } mu_CustomCommand;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect, uv; mu_Image image; } mu_ImageCommand;
+typedef struct { mu_CmdRect rect; int id; mu_Color color; } mu_Sprite;
+typedef struct { mu_BaseCommand base; mu_CmdRect rect; int count; mu_Sprite sprites[1]; } mu_SpritesCommand;
+typedef struct { unsigned char chr, fg, bg; } mu_GlyphCell;
+typedef struct { mu_BaseCommand base; mu_CmdVec2 pos; mu_Font font; int cols, rows, cell_w, cell_h; mu_Color palette[MU_PALETTE_SIZE]; mu_GlyphCell cells[1]; } mu_GlyphGridCommand;
 
 typedef union {
-  int type;
+  mu_CommandType type;
   mu_BaseCommand base;
   mu_JumpCommand jump;
   mu_ClipCommand clip;
@@ -140,8 +224,71 @@ typedef union {
   mu_TextCommand text;
   mu_IconCommand icon;
   mu_InptCommand input;
+  mu_FrameCommand frame;
+  mu_OriginCommand origin;
+  mu_TextRefCommand textref;
+  mu_TextBlockCommand textblock;
+  mu_TextSpansCommand textspans;
+  mu_PolylineCommand polyline;
+  mu_CustomCommand custom;
+  mu_GlyphGridCommand glyphgrid;
+  mu_ImageCommand image;
+  mu_SpritesCommand sprites;
 } mu_Command;
 
+struct mu_CommandChunk {
+  mu_CommandChunk *next;
+  int size; /* bytes of command storage following the chunk header */
+  int idx;  /* bytes used this frame */
+};
+
+typedef struct { mu_CommandChunk *head, *tail; } mu_CommandList;
+
+typedef struct {
+  int count;
+  unsigned char *type; /* MU_COMMAND_... of each primitive */
+  int *x, *y, *w, *h;
+  mu_Color *color;
+  int *clip;           /* index into `clips` of the clip rect in effect */
+  int *cmd;            /* offset of the source command in the flattened list */
+  mu_Rect *clips;
+  int clip_count;
+  int cap;
+} mu_PrimitiveList;
+
+/* where the glyphs, icons and a white area used for fills are in the texture
+** `image`: icon `id` is at `rects[id]`, character `c` at `rects[font + c]` */
+typedef struct {
+  mu_Image image;
+  const mu_Rect *rects;
+  int white, font;
+} mu_Atlas;
+
+/* `u` and `v` are in pixels of the range's image */
+typedef struct { float x, y, u, v; mu_Color color; } mu_Vertex;
+
+typedef struct {
+  int offset, count;   /* range of `indices` */
+  mu_Rect clip;
+  mu_Image image;
+  mu_Command *cmd;     /* a custom command to draw instead, if not NULL */
+  mu_Vec2 origin;      /* origin in effect for `cmd` */
+} mu_DrawRange;
+
+typedef struct {
+  mu_Vertex *vertices;
+  unsigned *indices;
+  mu_DrawRange *ranges;
+  int vertex_count, index_count, range_count;
+  int vertex_cap, range_cap;
+} mu_VertexList;
+
+typedef struct {
+  mu_CommandList commands;
+  mu_VertexList vertices;
+  int frame; /* value of ctx->frame when the buffer was last built */
+} mu_CommandBuffer;
+
 typedef struct {
   mu_Rect body;
   mu_Rect next;
@@ -167,6 +314,21 @@ typedef struct {
   int collapsed;
 } mu_Container;
 
+/* what a root container drew last frame, for working out damage */
+typedef struct {
+  mu_Container *container;
+  mu_Id hash;
+  mu_Rect rect;
+} mu_DrawnRoot;
+
+/* one mu_input_...() call, as passed to the context's `input_hook` */
+typedef struct {
+  int type;
+  int x, y;  /* mouse position or scroll amount */
+  int value; /* mouse button or key */
+  const char *text;
+} mu_InputEvent;
+
 typedef struct {
   mu_Font font;
   mu_Vec2 size;
@@ -179,11 +341,28 @@ typedef struct {
   mu_Color colors[MU_COLOR_MAX];
 } mu_Style;
 
+/* a grid of character cells written to like a terminal; `cells` is provided
+** by the user and holds cols * rows cells */
+typedef struct {
+  mu_GlyphCell *cells;
+  int cols, rows;
+  int cursor_x, cursor_y;
+  unsigned char fg, bg;
+  mu_Color palette[MU_PALETTE_SIZE];
+} mu_Console;
+
 struct mu_Context {
   /* callbacks */
   int (*text_width)(mu_Font font, const char *str, int len);
   int (*text_height)(mu_Font font);
   void (*draw_frame)(mu_Context *ctx, mu_Rect rect, int colorid, int draw_border);
+  void* (*alloc)(void *udata, void *ptr, int size);
+  void *alloc_udata;
+  void (*input_hook)(mu_Context *ctx, const mu_InputEvent *ev);
+  void *input_udata;
+  /* MU_CAP_... set for command types the renderer draws natively; others are
+  ** expanded into basic commands */
+  int caps;
   /* core state */
   mu_Style _style;
   mu_Style *style;
@@ -201,17 +380,38 @@ struct mu_Context {
   int dragging_mode;
   char number_edit_buf[MU_MAX_FMT];
   mu_Id number_edit;
+  /* set by mu_hint_id(): the next ID taken from `hint_data` is made from
+  ** `hint_digest` rather than by hashing the data */
+  const void *hint_data;
+  uint64_t hint_digest;
+  /* command list; `buffer_count` buffers (1 if unset) are rotated through at
+  ** mu_begin so that a finished frame can be consumed while the next is built */
+  mu_CommandBuffer buffers[MU_COMMANDBUFFERS];
+  mu_CommandBuffer *buffer;
+  int buffer_count;
+  char *flat_list;
+  int flat_size;
+  mu_PrimitiveList primitives;
+  mu_Atlas atlas;
+  mu_Vec2 origin;
+  mu_stack(int, MU_COMMANDTYPES_SIZE) command_types;
   /* stacks */
-  mu_stack(char, MU_COMMANDLIST_SIZE) command_list;
   mu_stack(mu_Container*, MU_ROOTLIST_SIZE) root_list;
+  mu_stack(mu_DrawnRoot, MU_ROOTLIST_SIZE) drawn_roots;
+  mu_stack(mu_Rect, MU_ROOTLIST_SIZE * 2) damage_list;
   mu_stack(mu_Container*, MU_CONTAINERSTACK_SIZE) container_stack;
+  mu_stack(mu_Vec2, MU_CONTAINERSTACK_SIZE) origin_stack;
   mu_stack(mu_Rect, MU_CLIPSTACK_SIZE) clip_stack;
   mu_stack(mu_Id, MU_IDSTACK_SIZE) id_stack;
   mu_stack(mu_Layout, MU_LAYOUTSTACK_SIZE) layout_stack;
   /* retained state pools */
-  mu_PoolItem container_pool[MU_CONTAINERPOOL_SIZE];
+  mu_Pool container_pool;
+  mu_PoolItem container_items[MU_CONTAINERPOOL_SIZE];
+  int container_index[MU_CONTAINERPOOL_SIZE * 2];
   mu_Container containers[MU_CONTAINERPOOL_SIZE];
-  mu_PoolItem treenode_pool[MU_TREENODEPOOL_SIZE];
+  mu_Pool treenode_pool;
+  mu_PoolItem treenode_items[MU_TREENODEPOOL_SIZE];
+  int treenode_index[MU_TREENODEPOOL_SIZE * 2];
   /* input state */
   mu_Vec2 mouse_pos;
   mu_Vec2 last_mouse_pos;
@@ -234,12 +434,19 @@ struct mu_Context {
 mu_Vec2 mu_vec2(int x, int y);
 mu_Rect mu_rect(int x, int y, int w, int h);
 mu_Color mu_color(int r, int g, int b, int a);
+#ifdef MU_COMPACT_COMMANDS
+mu_Rect mu_decode_rect(mu_CmdRect r);
+mu_Vec2 mu_decode_vec2(mu_CmdVec2 v);
+#endif
 
 void mu_init(mu_Context *ctx);
+void mu_deinit(mu_Context *ctx);
 void mu_begin(mu_Context *ctx);
 void mu_end(mu_Context *ctx);
 void mu_set_focus(mu_Context *ctx, mu_Id id);
 mu_Id mu_get_id(mu_Context *ctx, const void *data, int size);
+uint64_t mu_digest(const void *data, int size);
+void mu_hint_id(mu_Context *ctx, const void *data, uint64_t digest);
 void mu_push_id(mu_Context *ctx, const void *data, int size);
 void mu_pop_id(mu_Context *ctx);
 void mu_push_clip_rect(mu_Context *ctx, mu_Rect rect);
@@ -250,9 +457,11 @@ mu_Container* mu_get_current_container(mu_Context *ctx);
 mu_Container* mu_get_container(mu_Context *ctx, const char *name);
 void mu_bring_to_front(mu_Context *ctx, mu_Container *cnt);
 
-int mu_pool_init(mu_Context *ctx, mu_PoolItem *items, int len, mu_Id id);
-int mu_pool_get(mu_Context *ctx, mu_PoolItem *items, int len, mu_Id id);
-void mu_pool_update(mu_Context *ctx, mu_PoolItem *items, int idx);
+void mu_pool_setup(mu_Pool *pool, mu_PoolItem *items, int *index, int len);
+int mu_pool_init(mu_Context *ctx, mu_Pool *pool, mu_Id id);
+int mu_pool_get(mu_Context *ctx, mu_Pool *pool, mu_Id id);
+void mu_pool_update(mu_Context *ctx, mu_Pool *pool, int idx);
+void mu_pool_remove(mu_Context *ctx, mu_Pool *pool, int idx);
 
 void mu_input_mousemove(mu_Context *ctx, int x, int y);
 void mu_input_mousedown(mu_Context *ctx, int x, int y, int btn);
@@ -261,14 +470,36 @@ void mu_input_scroll(mu_Context *ctx, int x, int y);
 void mu_input_keydown(mu_Context *ctx, int key);
 void mu_input_keyup(mu_Context *ctx, int key);
 void mu_input_text(mu_Context *ctx, const char *text);
+void mu_input_event(mu_Context *ctx, const mu_InputEvent *ev);
 
 mu_Command* mu_push_command(mu_Context *ctx, int type, int size);
 int mu_next_command(mu_Context *ctx, mu_Command **cmd);
+int mu_next_buffer_command(mu_CommandBuffer *buf, mu_Command **cmd);
+mu_CommandBuffer* mu_get_command_buffer(mu_Context *ctx);
+mu_CommandBuffer* mu_next_command_buffer(mu_Context *ctx);
+int mu_flatten_commands(mu_Context *ctx, mu_Command **cmds);
+mu_PrimitiveList* mu_build_primitives(mu_Context *ctx);
+mu_Command* mu_primitive_command(mu_Context *ctx, int idx);
+mu_VertexList* mu_build_vertices(mu_Context *ctx);
+const char* mu_textblock_str(mu_Command *cmd);
+const char* mu_textspans_str(mu_Command *cmd);
+int mu_register_command(mu_Context *ctx, int payload_size);
+void* mu_push_custom_command(mu_Context *ctx, int type, mu_Rect rect);
+void* mu_command_payload(mu_Command *cmd);
+int mu_optimize_commands(mu_Context *ctx, int *bytes);
+int mu_frame_changed(mu_Context *ctx);
 void mu_set_clip(mu_Context *ctx, mu_Rect rect);
 void mu_draw_rect(mu_Context *ctx, mu_Rect rect, mu_Color color);
 void mu_draw_box(mu_Context *ctx, mu_Rect rect, mu_Color color);
+void mu_draw_frame(mu_Context *ctx, mu_Rect rect, mu_Color color, mu_Color border_color, int border);
 void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len, mu_Vec2 pos, mu_Color color);
+void mu_draw_text_ref(mu_Context *ctx, mu_Font font, const char *str, int len, mu_Vec2 pos, mu_Color color);
+void mu_draw_text_spans(mu_Context *ctx, mu_Font font, const char *str, int len, mu_Vec2 pos, const mu_TextSpan *spans, int count);
 void mu_draw_icon(mu_Context *ctx, int id, mu_Rect rect, mu_Color color);
+void mu_draw_sprites(mu_Context *ctx, const int *ids, const mu_Rect *rects, const mu_Color *colors, int count);
+void mu_draw_image(mu_Context *ctx, mu_Image image, mu_Rect rect, mu_Rect uv);
+void mu_draw_polyline(mu_Context *ctx, const mu_Vec2 *points, int count, mu_Color color);
+void mu_draw_glyph_grid(mu_Context *ctx, mu_Font font, const mu_GlyphCell *cells, int cols, int rows, mu_Vec2 pos, const mu_Color *palette);
 
 void mu_layout_row(mu_Context *ctx, int items, const int *widths, int height);
 void mu_layout_width(mu_Context *ctx, int width);
@@ -291,9 +522,11 @@ void mu_update_control(mu_Context *ctx, mu_Id id, mu_Rect rect, int opt);
 #define mu_begin_treenode(ctx, label)     mu_begin_treenode_ex(ctx, label, 0)
 #define mu_begin_window(ctx, title, rect) mu_begin_window_ex(ctx, title, rect, 0)
 #define mu_begin_panel(ctx, name)         mu_begin_panel_ex(ctx, name, 0)
+#define mu_text(ctx, text)                mu_text_ex(ctx, text, 0)
+#define mu_label(ctx, text)               mu_label_ex(ctx, text, 0)
 
-void mu_text(mu_Context *ctx, const char *text);
-void mu_label(mu_Context *ctx, const char *text);
+void mu_text_ex(mu_Context *ctx, const char *text, int opt);
+void mu_label_ex(mu_Context *ctx, const char *text, int opt);
 int mu_button_ex(mu_Context *ctx, const char *label, int icon, int opt);
 int mu_checkbox(mu_Context *ctx, const char *label, int *state);
 int mu_textbox_raw(mu_Context *ctx, char *buf, int bufsz, mu_Id id, mu_Rect r, int opt);
@@ -310,5 +543,9 @@ int mu_begin_popup(mu_Context *ctx, const char *name);
 void mu_end_popup(mu_Context *ctx);
 void mu_begin_panel_ex(mu_Context *ctx, const char *name, int opt);
 void mu_end_panel(mu_Context *ctx);
+void mu_console_init(mu_Console *con, mu_GlyphCell *cells, int cols, int rows);
+void mu_console_write(mu_Console *con, const char *str);
+void mu_console_clear(mu_Console *con);
+void mu_console(mu_Context *ctx, mu_Console *con);
 
 #endif
@@ -0,0 +1,174 @@
+/*
+** Copyright (c) 2024 rxi
+**
+** This library is free software; you can redistribute it and/or modify it
+** under the terms of the MIT license. See `microui.c` for details.
+*/
+
+#ifndef MICROUI_HPP
+#define MICROUI_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+extern "C" {
+#include "microui.h"
+}
+
+namespace mu {
+
+/* mu_digest() reads the label with native loads; this version assembles
+** them from bytes, which matches on little-endian targets only */
+static_assert(std::endian::native == std::endian::little,
+  "microui.hpp: compile-time IDs assume a little-endian target");
+
+constexpr uint64_t digest(std::string_view s) {
+  constexpr uint64_t k = 0x9e3779b97f4a7c15ULL;
+  auto load = [s](std::size_t i, int n) {
+    uint64_t v = 0;
+    while (n--) { v = v << 8 | (unsigned char) s[i + n]; }
+    return v;
+  };
+  std::size_t size = s.size(), i = 0;
+  uint64_t h = (uint64_t) size * k, w = 0;
+  for (; size > 8; size -= 8, i += 8) {
+    h = (h ^ load(i, 8)) * k;
+    h ^= h >> 32;
+  }
+  if (size >= 4) {
+    w = load(i, 4) | load(i + size - 4, 4) << 32;
+  } else if (size > 0) {
+    w = load(i, 1) | load(i + (size >> 1), 1) << 8 | load(i + size - 1, 1) << 16;
+  }
+  return (h ^ w) * k;
+}
+
+
+/* the length of the string in an array, up to its first NUL */
+constexpr std::size_t length(const char *s, std::size_t n) {
+  std::size_t i = 0;
+  while (i < n && s[i]) { i++; }
+  return i;
+}
+
+
+/* a NUL-terminated label and its digest. String literals and constexpr
+** arrays are hashed at compile time; other strings, including char
+** buffers, are hashed when the Label is made. A std::string_view must be
+** NUL-terminated at its size() */
+struct Label {
+  const char *str;
+  int len;
+  uint64_t digest;
+
+  template <std::size_t N>
+  consteval Label(const char (&s)[N])
+    : str(s), len((int) length(s, N)), digest(mu::digest({ s, length(s, N) })) {}
+  template <std::size_t N>
+  Label(char (&s)[N]) : Label(std::string_view(s, length(s, N))) {}
+  Label(std::string_view s)
+    : str(s.data()), len((int) s.size()), digest(mu::digest(s)) {}
+  Label(const std::string &s) : Label(std::string_view(s)) {}
+
+  void hint(mu_Context *ctx) const { mu_hint_id(ctx, str, digest); }
+};
+
+
+inline int button(mu_Context *ctx, Label label, int opt = MU_OPT_ALIGNCENTER) {
+  label.hint(ctx);
+  return mu_button_ex(ctx, label.str, 0, opt);
+}
+
+inline int header(mu_Context *ctx, Label label, int opt = 0) {
+  label.hint(ctx);
+  return mu_header_ex(ctx, label.str, opt);
+}
+
+inline void open_popup(mu_Context *ctx, Label name) {
+  name.hint(ctx);
+  mu_open_popup(ctx, name.str);
+}
+
+
+/* RAII scopes: each calls the matching mu_end_.../mu_pop_... when it goes
+** out of scope, and only if the begin call succeeded. Windows, popups and
+** treenodes convert to bool to test that */
+class Scope {
+public:
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+  explicit operator bool() const { return open; }
+
+protected:
+  Scope(mu_Context *ctx) : ctx(ctx), open(0) {}
+  mu_Context *ctx;
+  int open;
+};
+
+class Window : public Scope {
+public:
+  Window(mu_Context *ctx, Label title, mu_Rect rect, int opt = 0) : Scope(ctx) {
+    title.hint(ctx);
+    open = mu_begin_window_ex(ctx, title.str, rect, opt);
+  }
+  ~Window() { if (open) { mu_end_window(ctx); } }
+};
+
+class Popup : public Scope {
+public:
+  Popup(mu_Context *ctx, Label name) : Scope(ctx) {
+    name.hint(ctx);
+    open = mu_begin_popup(ctx, name.str);
+  }
+  ~Popup() { if (open) { mu_end_popup(ctx); } }
+};
+
+class Panel : public Scope {
+public:
+  Panel(mu_Context *ctx, Label name, int opt = 0) : Scope(ctx) {
+    name.hint(ctx);
+    mu_begin_panel_ex(ctx, name.str, opt);
+    open = 1;
+  }
+  ~Panel() { mu_end_panel(ctx); }
+};
+
+class TreeNode : public Scope {
+public:
+  TreeNode(mu_Context *ctx, Label label, int opt = 0) : Scope(ctx) {
+    label.hint(ctx);
+    open = mu_begin_treenode_ex(ctx, label.str, opt);
+  }
+  ~TreeNode() { if (open) { mu_end_treenode(ctx); } }
+};
+
+class IdScope : public Scope {
+public:
+  IdScope(mu_Context *ctx, const void *data, int size) : Scope(ctx) {
+    mu_push_id(ctx, data, size);
+    open = 1;
+  }
+  IdScope(mu_Context *ctx, int index) : IdScope(ctx, &index, sizeof(index)) {}
+  IdScope(mu_Context *ctx, Label label) : Scope(ctx) {
+    label.hint(ctx);
+    mu_push_id(ctx, label.str, label.len);
+    open = 1;
+  }
+  ~IdScope() { mu_pop_id(ctx); }
+};
+
+class Column : public Scope {
+public:
+  Column(mu_Context *ctx) : Scope(ctx) {
+    mu_layout_begin_column(ctx);
+    open = 1;
+  }
+  ~Column() { mu_layout_end_column(ctx); }
+};
+
+}
+
+#endif